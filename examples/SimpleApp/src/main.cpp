@@ -66,6 +66,9 @@ public:
         appConfig.onUpdate([this]() {
             Serial.println("Updated config!");
         });
+        appConfig.uptimeInterval.onChange([](const seconds& interval) {
+            Serial.printf("Uptime interval changed to %ld seconds\n", (long) interval.count());
+        });
     }
 
 protected:
@@ -9,12 +9,20 @@
 #include <Farmhub.hpp>
 #include <MdnsHandler.hpp>
 #include <MqttHandler.hpp>
+#include <NvsConfiguration.hpp>
 #include <OtaHandler.hpp>
+#include <PowerManager.hpp>
 #include <Sleep.hpp>
 #include <Telemetry.hpp>
+#include <WallClock.hpp>
+#include <commands/ConfigSchemaCommand.hpp>
 #include <commands/EchoCommand.hpp>
 #include <commands/FileCommands.hpp>
 #include <commands/HttpUpdateCommand.hpp>
+#include <commands/MqttMetricsCommand.hpp>
+#include <commands/TelemetryMetricsCommand.hpp>
+#include <commands/TelemetryQueryCommand.hpp>
+#include <commands/WiFiMetricsCommand.hpp>
 #include <commands/PingCommand.hpp>
 #include <commands/ResetWifiCommand.hpp>
 #include <commands/RestartCommand.hpp>
@@ -22,6 +30,13 @@
 
 namespace farmhub { namespace client {
 
+// Build with -DFARMHUB_NVS_CONFIGURATION to store the application configuration in NVS
+#ifdef FARMHUB_NVS_CONFIGURATION
+typedef NvsConfiguration AppConfigurationBase;
+#else
+typedef FileConfiguration AppConfigurationBase;
+#endif
+
 class Application {
 public:
     void begin() {
@@ -37,9 +52,8 @@ public:
         DeviceConfiguration(
             const String& defaultType,
             const String& defaultModel,
-            const String& path = "/device-config.json",
-            size_t capacity = 2048)
-            : FileConfiguration("device", path, capacity)
+            const String& path = "/device-config.json")
+            : FileConfiguration("device", path)
             , type(this, "type", defaultType)
             , model(this, "model", defaultModel)
             , instance(this, "instance", getMacAddress()) {
@@ -50,6 +64,7 @@ public:
         Property<String> instance;
 
         MqttHandler::Config mqtt { this, "mqtt" };
+        WiFiProvider::Config wifi { this };
 
         virtual bool isResetButtonPressed() {
             return false;
@@ -63,14 +78,22 @@ public:
         }
     };
 
-    class AppConfiguration : public FileConfiguration {
+    class AppConfiguration : public AppConfigurationBase {
     public:
-        AppConfiguration(seconds defaultHeartbeat = minutes { 1 })
-            : FileConfiguration("application", "/config.json")
-            , heartbeat(this, "heartbeat", defaultHeartbeat) {
+        AppConfiguration(seconds defaultHeartbeat = minutes { 1 }, seconds defaultMaxSilence = seconds::zero())
+            : AppConfigurationBase("application", "/config.json")
+            , heartbeat(this, "heartbeat", defaultHeartbeat)
+            , maxSilence(this, "maxSilence", defaultMaxSilence) {
         }
 
         Property<seconds> heartbeat;
+
+        /**
+         * @brief Publish only changed telemetry at heartbeats, but everything at least this often; zero publishes everything.
+         */
+        Property<seconds> maxSilence;
+
+        PowerManager::Config power { this };
     };
 
 protected:
@@ -87,23 +110,41 @@ protected:
         , appConfig(appConfig)
         , wifiProvider(wifiProvider)
         , resetWifiCommand(wifiProvider)
+        , wifiMetricsCommand(wifiProvider)
         , httpUpdateCommand(version)
         , tasks(maxSleepTime) {
 
+        telemetryPublisher.setMaxSilence(appConfig.maxSilence);
+
         mqtt.registerCommand("echo", echoCommand);
         mqtt.registerCommand("ping", pingCommand);
         mqtt.registerCommand("reset-wifi", resetWifiCommand);
+        mqtt.registerCommand("wifi/metrics", wifiMetricsCommand);
         mqtt.registerCommand("restart", restartCommand);
         mqtt.registerCommand("files/list", fileListCommand);
         mqtt.registerCommand("files/read", fileReadCommand);
         mqtt.registerCommand("files/write", fileWriteCommand);
         mqtt.registerCommand("files/remove", fileRemoveCommand);
         mqtt.registerCommand("update", httpUpdateCommand);
+        mqtt.registerCommand("mqtt/metrics", mqttMetricsCommand);
+        mqtt.registerCommand("config/schema", configSchemaCommand);
+        mqtt.registerCommand("telemetry/metrics", telemetryMetricsCommand);
+        mqtt.registerCommand("telemetry/query", telemetryQueryCommand);
+        telemetryMetricsCommand.addPublisher(telemetryPublisher);
     }
 
     virtual void beginApp() {
     }
 
+    /**
+     * @brief Called before the network is started; applications can do their work and go back to sleep here without it.
+     *
+     * The configuration is already loaded and the time series store is started, but nothing else has been started yet.
+     * Does not return if the application goes to deep sleep.
+     */
+    virtual void beginOffline() {
+    }
+
     const String name;
     const String version;
 
@@ -115,6 +156,9 @@ private:
 
         beginFileSystem();
 
+        // The RTC keeps time across deep sleep
+        WallClock::synchronize();
+
         const String& hostname = deviceConfig.getHostname();
 
         Serial.printf("Running on %s %s instance '%s' with hostname '%s'\n",
@@ -127,6 +171,14 @@ private:
         } else {
             appConfig.begin();
         }
+        deviceConfig.begin();
+
+        power.begin();
+
+        // Before beginOffline(), so that telemetry sampled without the network is stored, too
+        timeSeries.begin();
+
+        beginOffline();
 
         mdns.begin(hostname, name, version);
 
@@ -147,11 +199,10 @@ private:
             Serial.println("WiFi: disconnected");
         },
             ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
-        wifiProvider.begin(hostname);
+        wifiProvider.begin(hostname, deviceConfig.wifi);
 
         otaHandler.begin(hostname);
 
-        deviceConfig.begin();
         String mqttClientId = deviceConfig.mqtt.clientId.get();
         if (mqttClientId.isEmpty()) {
             mqttClientId = name + "-" + deviceConfig.instance.get();
@@ -164,6 +215,8 @@ private:
 
         beginApp();
 
+        Serial.printf("Started in %lu ms\n", millis());
+
         sleep.handleWake();
     }
 
@@ -174,6 +227,12 @@ private:
             return;
         }
 
+        // Only list files on a cold boot, waking from sleep should be quick
+        if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED) {
+            Serial.println("done");
+            return;
+        }
+
         Serial.println("contents:");
         File root = SPIFFS.open("/", FILE_READ);
         while (true) {
@@ -229,7 +288,8 @@ private:
                     json["app"] = app;
                     json["version"] = version;
                     json["wakeup"] = event.source;
-                });
+                },
+                MqttHandler::Retention::NoRetain, MqttHandler::QoS::AtMostOnce, MqttHandler::Timestamp::Include);
         }
 
     private:
@@ -245,23 +305,30 @@ private:
 
 public:
     TaskContainer tasks;
+    PowerManager power { tasks, appConfig.power };
     MdnsHandler mdns;
     SleepHandler sleep;
     MqttHandler mqtt { tasks, mdns, sleep, appConfig };
-    TelemetryPublisher telemetryPublisher { tasks, mqtt, appConfig.heartbeat };
+    TelemetryPublisher telemetryPublisher { tasks, mqtt, power.scaled(appConfig.heartbeat), "telemetry" };
     EventHandler events { mqtt, telemetryPublisher };
+    commands::TelemetryMetricsCommand telemetryMetricsCommand;
+    TimeSeriesStore timeSeries;
 
 private:
     OtaHandler otaHandler { tasks };
     ReportWakeUpHandler wakeUpHandler { sleep, mqtt, name, version, deviceConfig };
 
+    commands::ConfigSchemaCommand configSchemaCommand { appConfig, deviceConfig };
     commands::EchoCommand echoCommand;
     commands::FileListCommand fileListCommand;
     commands::FileReadCommand fileReadCommand;
     commands::FileWriteCommand fileWriteCommand;
     commands::FileRemoveCommand fileRemoveCommand;
     commands::HttpUpdateCommand httpUpdateCommand;
+    commands::MqttMetricsCommand mqttMetricsCommand { mqtt };
+    commands::TelemetryQueryCommand telemetryQueryCommand { timeSeries };
     commands::ResetWifiCommand resetWifiCommand;
+    commands::WiFiMetricsCommand wifiMetricsCommand;
     commands::RestartCommand restartCommand;
     commands::PingCommand pingCommand { telemetryPublisher };
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Anything before 2020-01-01T00:00:00Z means the clock has not been set yet
+#define CLOCK_MAPPING_VALID_UTC_MIN 1577836800LL
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Maps monotonic time since boot to UTC.
+ *
+ * Times captured since boot can be converted to UTC as soon as the mapping is known,
+ * even if they were captured before the clock has been synchronized.
+ */
+class ClockMapping {
+public:
+    /**
+     * @brief Records that <code>bootMicros</code> since boot corresponds to <code>utcMicros</code> since the UNIX epoch.
+     *
+     * @return the correction applied to the previous mapping in microseconds, zero if this is the first synchronization.
+     */
+    int64_t synchronize(int64_t bootMicros, int64_t utcMicros) {
+        int64_t newOffset = utcMicros - bootMicros;
+        int64_t correction = synchronized ? newOffset - offset : 0;
+        offset = newOffset;
+        synchronized = true;
+        return correction;
+    }
+
+    bool isSynchronized() const {
+        return synchronized;
+    }
+
+    /**
+     * @brief Converts a time since boot to milliseconds since the UNIX epoch, returns false if the mapping is not known yet.
+     */
+    bool toUtcMillis(int64_t bootMicros, int64_t& utcMillis) const {
+        if (!synchronized) {
+            return false;
+        }
+        utcMillis = (bootMicros + offset) / 1000;
+        return true;
+    }
+
+    static bool isValidUtc(int64_t utcMicros) {
+        return utcMicros >= CLOCK_MAPPING_VALID_UTC_MIN * 1000000;
+    }
+
+private:
+    int64_t offset = 0;
+    bool synchronized = false;
+};
+
+}}    // namespace farmhub::client
@@ -2,10 +2,14 @@
 
 #include <ArduinoJson.h>
 #include <SPIFFS.h>
+#include <esp_rom_crc.h>
 #include <functional>
 #include <list>
+#include <memory>
+#include <type_traits>
 
 #include <Farmhub.hpp>
+#include <JsonMergePatch.hpp>
 
 using std::list;
 using std::ref;
@@ -13,17 +17,255 @@ using std::reference_wrapper;
 
 namespace farmhub { namespace client {
 
+/**
+ * @brief Calculates the 64-bit FNV-1a hash of JSON content as it is serialized, without buffering it.
+ */
+class JsonHasher {
+public:
+    static uint64_t hash(JsonVariantConst json) {
+        JsonHasher hasher;
+        serializeJson(json, hasher);
+        return hasher.digest();
+    }
+
+    uint64_t digest() const {
+        return value;
+    }
+
+    size_t write(uint8_t c) {
+        value = (value ^ c) * 1099511628211ULL;
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            write(buffer[i]);
+        }
+        return length;
+    }
+
+private:
+    uint64_t value = 14695981039346656037ULL;
+};
+
+/**
+ * @brief Calculates the capacity a document needs to hold a copy of the given JSON value.
+ *
+ * Strings are assumed to be copied, so the result is an upper bound.
+ */
+size_t jsonCapacityOf(JsonVariantConst json) {
+    if (json.is<JsonObjectConst>()) {
+        size_t capacity = 0;
+        for (JsonPairConst pair : json.as<JsonObjectConst>()) {
+            capacity += JSON_OBJECT_SIZE(1) + strlen(pair.key().c_str()) + 1 + jsonCapacityOf(pair.value());
+        }
+        return capacity;
+    } else if (json.is<JsonArrayConst>()) {
+        size_t capacity = 0;
+        for (JsonVariantConst element : json.as<JsonArrayConst>()) {
+            capacity += JSON_ARRAY_SIZE(1) + jsonCapacityOf(element);
+        }
+        return capacity;
+    } else if (json.is<const char*>()) {
+        return strlen(json.as<const char*>()) + 1;
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * @brief Returns the JSON schema type of a JSON value.
+ */
+const char* jsonSchemaTypeOf(JsonVariantConst json) {
+    if (json.is<bool>()) {
+        return "boolean";
+    } else if (json.is<long>() || json.is<unsigned long>()) {
+        return "integer";
+    } else if (json.is<double>()) {
+        return "number";
+    } else if (json.is<const char*>()) {
+        return "string";
+    } else if (json.is<JsonArrayConst>()) {
+        return "array";
+    } else if (json.is<JsonObjectConst>()) {
+        return "object";
+    } else {
+        return "null";
+    }
+}
+
+/**
+ * @brief Storage of binary configuration records keyed by the path of the entry.
+ */
+class ConfigurationStore {
+public:
+    /**
+     * @brief Returns the size of the record, or 0 if there is no record stored under the path.
+     */
+    virtual size_t size(const String& path) = 0;
+    virtual size_t read(const String& path, void* buffer, size_t length) = 0;
+    virtual bool write(const String& path, const void* buffer, size_t length) = 0;
+    virtual void remove(const String& path) = 0;
+};
+
+/**
+ * @brief Converts property values to and from binary records.
+ *
+ * Trivially copyable types (numbers, enums, durations) are stored as-is.
+ * Other types need to specialize this template.
+ */
+template <typename T>
+struct BinaryConverter {
+    static_assert(std::is_trivially_copyable<T>::value,
+        "Only trivially copyable types can be stored as binary without a BinaryConverter specialization");
+
+    static bool read(ConfigurationStore& store, const String& path, T& value) {
+        if (store.size(path) != sizeof(T)) {
+            return false;
+        }
+        return store.read(path, &value, sizeof(T)) == sizeof(T);
+    }
+
+    static bool write(ConfigurationStore& store, const String& path, const T& value) {
+        return store.write(path, &value, sizeof(T));
+    }
+};
+
+template <>
+struct BinaryConverter<String> {
+    static bool read(ConfigurationStore& store, const String& path, String& value) {
+        size_t length = store.size(path);
+        if (length == 0) {
+            return false;
+        }
+        std::unique_ptr<char[]> buffer(new char[length + 1]);
+        length = store.read(path, buffer.get(), length);
+        buffer[length] = 0;
+        value = buffer.get();
+        return true;
+    }
+
+    static bool write(ConfigurationStore& store, const String& path, const String& value) {
+        // Store the terminating zero, too, so that empty strings are distinguishable from missing ones
+        return store.write(path, value.c_str(), value.length() + 1);
+    }
+};
+
+/**
+ * @brief Capacity needed to store a property value in a JSON document on top of its slot.
+ *
+ * Only strings need extra space, as they are copied into the document.
+ */
+template <typename T>
+struct JsonValueCapacity {
+    static size_t of(const T& value) {
+        return 0;
+    }
+};
+
+template <>
+struct JsonValueCapacity<String> {
+    static size_t of(const String& value) {
+        return value.length() + 1;
+    }
+};
+
 class ConfigurationEntry {
 public:
     virtual void load(const JsonObject& json) = 0;
     virtual void reset() = 0;
     virtual void store(JsonObject& json, bool inlineDefaults) const = 0;
     virtual bool hasValue() const = 0;
+
+    /**
+     * @brief Applies a JSON merge patch to the entry.
+     *
+     * Unlike <code>load()</code>, the entry is left untouched if its key is missing from the patch.
+     * A <code>null</code> value resets the entry to its default.
+     */
+    virtual void patch(const JsonObject& json) = 0;
+
+    /**
+     * @brief Returns whether the entry handles the given key of the enclosing JSON object.
+     */
+    virtual bool hasKey(const char* key) const = 0;
+
+    /**
+     * @brief Checks the part of the enclosing JSON object handled by the entry for keys that no entry handles.
+     *
+     * Unknown keys are logged with the given location.
+     *
+     * @return false if there are unknown keys.
+     */
+    virtual bool validate(const JsonObject& json, const String& location) const {
+        return true;
+    }
+
+    /**
+     * @brief Returns the capacity needed to store the entry via <code>store(json, true)</code>.
+     */
+    virtual size_t jsonCapacity() const = 0;
+
+    /**
+     * @brief Adds the JSON schema of the entry to the given <code>properties</code> of the enclosing object.
+     */
+    virtual void describe(JsonObject& properties) const = 0;
+
+    /**
+     * @brief Returns the capacity needed to add the JSON schema of the entry via <code>describe()</code>.
+     */
+    virtual size_t schemaCapacity() const = 0;
+
+    /**
+     * @brief Loads the entry from binary records under the given path prefix.
+     */
+    virtual void loadBinary(ConfigurationStore& store, const String& prefix) = 0;
+
+    /**
+     * @brief Stores the entry as binary records under the given path prefix.
+     */
+    virtual void storeBinary(ConfigurationStore& store, const String& prefix) const = 0;
+
+protected:
+    /**
+     * @brief Marks the effective value of this entry (and of its parents) as changed.
+     *
+     * Listeners are notified later via {@link #notifyChanges}, once the whole configuration is loaded.
+     */
+    void markChanged() {
+        changePending = true;
+        if (parent != nullptr) {
+            parent->markChanged();
+        }
+    }
+
+    /**
+     * @brief Notifies listeners of this entry if it has changed since the last notification.
+     */
+    virtual void notifyChanges() {
+        if (changePending) {
+            changePending = false;
+            onChanged();
+        }
+    }
+
+    /**
+     * @brief Called when the effective value of the entry has changed.
+     */
+    virtual void onChanged() {
+    }
+
+private:
+    ConfigurationEntry* parent = nullptr;
+    bool changePending = false;
+
+    friend class ConfigurationSection;
 };
 
 class ConfigurationSection : public ConfigurationEntry {
 public:
     void add(ConfigurationEntry& entry) {
+        entry.parent = this;
         auto reference = std::ref(entry);
         entries.push_back(reference);
     }
@@ -40,6 +282,12 @@ public:
         }
     }
 
+    virtual void patch(const JsonObject& json) override {
+        for (auto& entry : entries) {
+            entry.get().patch(json);
+        }
+    }
+
     virtual void store(JsonObject& json, bool inlineDefaults) const override {
         for (auto& entry : entries) {
             entry.get().store(json, inlineDefaults);
@@ -55,6 +303,73 @@ public:
         return false;
     }
 
+    virtual bool hasKey(const char* key) const override {
+        for (auto& entry : entries) {
+            if (entry.get().hasKey(key)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    virtual bool validate(const JsonObject& json, const String& location) const override {
+        bool valid = true;
+        for (JsonPair pair : json) {
+            if (!ConfigurationSection::hasKey(pair.key().c_str())) {
+                Serial.printf("Unknown configuration key '%s' in %s\n",
+                    pair.key().c_str(), location.c_str());
+                valid = false;
+            }
+        }
+        for (auto& entry : entries) {
+            valid &= entry.get().validate(json, location);
+        }
+        return valid;
+    }
+
+    virtual size_t jsonCapacity() const override {
+        size_t capacity = 0;
+        for (auto& entry : entries) {
+            capacity += entry.get().jsonCapacity();
+        }
+        return capacity;
+    }
+
+    virtual void describe(JsonObject& properties) const override {
+        for (auto& entry : entries) {
+            entry.get().describe(properties);
+        }
+    }
+
+    virtual size_t schemaCapacity() const override {
+        size_t capacity = 0;
+        for (auto& entry : entries) {
+            capacity += entry.get().schemaCapacity();
+        }
+        return capacity;
+    }
+
+    virtual void loadBinary(ConfigurationStore& store, const String& prefix) override {
+        for (auto& entry : entries) {
+            entry.get().loadBinary(store, prefix);
+        }
+    }
+
+    virtual void storeBinary(ConfigurationStore& store, const String& prefix) const override {
+        for (auto& entry : entries) {
+            entry.get().storeBinary(store, prefix);
+        }
+    }
+
+protected:
+    void notifyChanges() override {
+        // Notify entries first, so that section listeners see the final state of the whole section
+        for (auto& entry : entries) {
+            entry.get().notifyChanges();
+        }
+        ConfigurationEntry::notifyChanges();
+    }
+
 private:
     list<reference_wrapper<ConfigurationEntry>> entries;
 };
@@ -69,8 +384,26 @@ public:
     void load(const JsonObject& json) override {
         if (json.containsKey(name)) {
             namePresentAtLoad = true;
-            ConfigurationSection::load(json[name]);
+            JsonObject section = json[name];
+            ConfigurationSection::load(section);
+        } else {
+            reset();
+        }
+    }
+
+    void patch(const JsonObject& json) override {
+        if (!json.containsKey(name)) {
+            return;
+        }
+        JsonVariant value = json[name];
+        if (value.is<JsonObject>()) {
+            namePresentAtLoad = true;
+            JsonObject section = value;
+            ConfigurationSection::patch(section);
         } else {
+            if (!value.isNull()) {
+                Serial.println("Resetting section '" + name + "' patched with a value that is not an object");
+            }
             reset();
         }
     }
@@ -86,14 +419,67 @@ public:
         return namePresentAtLoad || ConfigurationSection::hasValue();
     }
 
+    bool hasKey(const char* key) const override {
+        return name == key;
+    }
+
+    bool validate(const JsonObject& json, const String& location) const override {
+        JsonVariant value = json[name];
+        if (!value.is<JsonObject>()) {
+            return true;
+        }
+        return ConfigurationSection::validate(value.as<JsonObject>(), "section '" + name + "'");
+    }
+
+    size_t jsonCapacity() const override {
+        return JSON_OBJECT_SIZE(1) + name.length() + 1 + ConfigurationSection::jsonCapacity();
+    }
+
+    void describe(JsonObject& properties) const override {
+        JsonObject section = properties.createNestedObject(name);
+        section["type"] = "object";
+        JsonObject sectionProperties = section.createNestedObject("properties");
+        ConfigurationSection::describe(sectionProperties);
+        section["additionalProperties"] = false;
+    }
+
+    size_t schemaCapacity() const override {
+        // The section, and its type, properties and additionalProperties
+        return JSON_OBJECT_SIZE(1) + name.length() + 1 + JSON_OBJECT_SIZE(3) + ConfigurationSection::schemaCapacity();
+    }
+
     void reset() override {
         namePresentAtLoad = false;
         ConfigurationSection::reset();
     }
 
+    void loadBinary(ConfigurationStore& store, const String& prefix) override {
+        namePresentAtLoad = false;
+        ConfigurationSection::loadBinary(store, prefix + name + ".");
+    }
+
+    void storeBinary(ConfigurationStore& store, const String& prefix) const override {
+        ConfigurationSection::storeBinary(store, prefix + name + ".");
+    }
+
+    /**
+     * @brief Registers a listener to be called when the effective value of any entry in the section changes.
+     */
+    void onChange(const std::function<void()>& listener) {
+        listeners.push_back(listener);
+    }
+
+protected:
+    void onChanged() override {
+        for (auto& listener : listeners) {
+            listener();
+        }
+    }
+
 private:
     const String name;
     bool namePresentAtLoad = false;
+    std::list<std::function<void()>> listeners;
 };
 
 template <typename T>
@@ -117,19 +503,63 @@ public:
 
     void load(const JsonObject& json) override {
         if (json.containsKey(name)) {
+            T previous = get();
             set(json[name].as<T>());
+            if (!(get() == previous)) {
+                markChanged();
+            }
         } else {
             reset();
         }
     }
 
+    void patch(const JsonObject& json) override {
+        if (!json.containsKey(name)) {
+            return;
+        }
+        if (json[name].isNull()) {
+            reset();
+        } else {
+            load(json);
+        }
+    }
+
     bool hasValue() const override {
         return configured;
     }
 
+    bool hasKey(const char* key) const override {
+        return name == key;
+    }
+
+    size_t jsonCapacity() const override {
+        return JSON_OBJECT_SIZE(1) + name.length() + 1 + (secret ? 0 : JsonValueCapacity<T>::of(get()));
+    }
+
+    void describe(JsonObject& properties) const override {
+        JsonObject property = properties.createNestedObject(name);
+        if (secret) {
+            property["type"] = "string";
+            property["writeOnly"] = true;
+            return;
+        }
+        // Determine the JSON type from how the default value is converted to JSON
+        property["default"] = defaultValue;
+        property["type"] = jsonSchemaTypeOf(property["default"]);
+    }
+
+    size_t schemaCapacity() const override {
+        // Either type and writeOnly, or default and type
+        return JSON_OBJECT_SIZE(1) + name.length() + 1 + JSON_OBJECT_SIZE(2) + (secret ? 0 : JsonValueCapacity<T>::of(defaultValue));
+    }
+
     void reset() override {
+        T previous = get();
         configured = false;
         value = T();
+        if (!(get() == previous)) {
+            markChanged();
+        }
     }
 
     void store(JsonObject& json, bool inlineDefaults) const override {
@@ -143,65 +573,270 @@ public:
         }
     }
 
+    void loadBinary(ConfigurationStore& store, const String& prefix) override {
+        T loaded;
+        if (BinaryConverter<T>::read(store, prefix + name, loaded)) {
+            T previous = get();
+            set(loaded);
+            if (!(get() == previous)) {
+                markChanged();
+            }
+        } else {
+            reset();
+        }
+    }
+
+    void storeBinary(ConfigurationStore& store, const String& prefix) const override {
+        if (configured) {
+            BinaryConverter<T>::write(store, prefix + name, value);
+        } else {
+            store.remove(prefix + name);
+        }
+    }
+
+    /**
+     * @brief Registers a listener to be called with the new effective value when it changes.
+     */
+    void onChange(const std::function<void(const T&)>& listener) {
+        listeners.push_back(listener);
+    }
+
+protected:
+    void onChanged() override {
+        for (auto& listener : listeners) {
+            listener(get());
+        }
+    }
+
 private:
     const String name;
     const bool secret;
     bool configured = false;
     T value;
     const T defaultValue;
+    std::list<std::function<void(const T&)>> listeners;
 };
 
+/**
+ * @brief A configuration entry holding arbitrary JSON.
+ *
+ * The entry keeps its own copy of the value in a dedicated document, so that it stays valid
+ * after the JSON it was loaded from is gone. The document is sized to the value,
+ * and is reused across updates as long as the new value fits into it.
+ */
 class RawJsonEntry : public ConfigurationEntry {
 public:
     RawJsonEntry(ConfigurationSection* parent, const String& name)
-        : name(name) {
+        : name(name)
+        , valueHash(JsonHasher::hash(JsonVariantConst())) {
         parent->add(*this);
     }
 
     void load(const JsonObject& json) override {
         if (json.containsKey(name)) {
-            value = json[name];
+            assign(json[name]);
         } else {
-            value.clear();
+            clear();
         }
+        updateHash();
     }
 
     void store(JsonObject& json, bool inlineDefaults) const override {
-        json[name] = value;
+        json[name] = get();
     }
 
     void reset() override {
-        value.clear();
+        clear();
+        updateHash();
+    }
+
+    void patch(const JsonObject& json) override {
+        if (!json.containsKey(name)) {
+            return;
+        }
+        JsonVariantConst patchValue = json[name];
+        if (patchValue.isNull()) {
+            clear();
+        } else {
+            DynamicJsonDocument merged(jsonCapacityOf(get()) + jsonCapacityOf(patchValue));
+            merged.set(get());
+            applyMergePatch(merged.as<JsonVariant>(), patchValue);
+            assign(merged.as<JsonVariantConst>());
+        }
+        updateHash();
     }
 
     JsonVariant get() {
-        return value;
+        return arena == nullptr
+            ? JsonVariant()
+            : arena->as<JsonVariant>();
+    }
+
+    JsonVariantConst get() const {
+        return arena == nullptr
+            ? JsonVariantConst()
+            : arena->as<JsonVariantConst>();
     }
 
     bool hasValue() const override {
-        return !value.isNull();
+        return !get().isNull();
+    }
+
+    bool hasKey(const char* key) const override {
+        return name == key;
+    }
+
+    size_t jsonCapacity() const override {
+        return JSON_OBJECT_SIZE(1) + name.length() + 1 + jsonCapacityOf(get());
+    }
+
+    void describe(JsonObject& properties) const override {
+        // Raw JSON can be anything
+        properties.createNestedObject(name);
+    }
+
+    size_t schemaCapacity() const override {
+        return JSON_OBJECT_SIZE(1) + name.length() + 1;
+    }
+
+    /**
+     * @brief Loads the value stored as MessagePack.
+     */
+    void loadBinary(ConfigurationStore& store, const String& prefix) override {
+        String path = prefix + name;
+        size_t length = store.size(path);
+        if (length == 0) {
+            clear();
+        } else {
+            std::unique_ptr<uint8_t[]> buffer(new uint8_t[length]);
+            length = store.read(path, buffer.get(), length);
+            // Strings are copied into the document, so start with twice the size of the input
+            size_t capacity = length * 2 + JSON_OBJECT_SIZE(1);
+            while (true) {
+                reserve(capacity);
+                auto error = deserializeMsgPack(*arena, reinterpret_cast<const char*>(buffer.get()), length);
+                if (error != DeserializationError::NoMemory) {
+                    if (error) {
+                        Serial.println("Failed to read " + path + ": " + String(error.c_str()));
+                        clear();
+                    }
+                    break;
+                }
+                capacity *= 2;
+            }
+        }
+        updateHash();
+    }
+
+    void storeBinary(ConfigurationStore& store, const String& prefix) const override {
+        String path = prefix + name;
+        JsonVariantConst value = get();
+        if (value.isNull()) {
+            store.remove(path);
+            return;
+        }
+        size_t length = measureMsgPack(value);
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[length]);
+        serializeMsgPack(value, buffer.get(), length);
+        store.write(path, buffer.get(), length);
+    }
+
+    /**
+     * @brief Registers a listener to be called with the new value when its contents change.
+     */
+    void onChange(const std::function<void(JsonVariant)>& listener) {
+        listeners.push_back(listener);
+    }
+
+protected:
+    void onChanged() override {
+        for (auto& listener : listeners) {
+            listener(get());
+        }
     }
 
 private:
+    /**
+     * @brief Makes sure the arena can hold at least the given capacity, discarding its contents.
+     */
+    void reserve(size_t capacity) {
+        if (arena == nullptr || arena->capacity() < capacity) {
+            arena.reset(new DynamicJsonDocument(capacity));
+        } else {
+            arena->clear();
+        }
+    }
+
+    void assign(JsonVariantConst source) {
+        reserve(jsonCapacityOf(source));
+        if (!arena->set(source)) {
+            Serial.println("Failed to copy configuration entry '" + name + "'");
+        }
+    }
+
+    void clear() {
+        // Keep the memory around for the next value
+        if (arena != nullptr) {
+            arena->clear();
+        }
+    }
+
+    // Compare by hash, as the previous value has been overwritten by now
+    void updateHash() {
+        uint64_t hash = JsonHasher::hash(get());
+        if (hash != valueHash) {
+            valueHash = hash;
+            markChanged();
+        }
+    }
+
     const String name;
-    JsonVariant value;
+    std::unique_ptr<DynamicJsonDocument> arena;
+    uint64_t valueHash;
+    std::list<std::function<void(JsonVariant)>> listeners;
 };
 
 class Configuration : protected ConfigurationSection {
 public:
-    Configuration(const String& name, size_t capacity = 2048)
-        : name(name)
-        , capacity(capacity) {
+    Configuration(const String& name)
+        : name(name) {
     }
 
     void reset() override {
         ConfigurationSection::reset();
+        notifyChanges();
     }
 
     virtual void update(const JsonObject& json) {
         load(json);
     }
 
+    /**
+     * @brief Applies a JSON merge patch (RFC 7386) on top of the current configuration.
+     *
+     * Only the entries mentioned in the patch are changed, and <code>null</code> values reset entries to their defaults.
+     */
+    virtual void patch(const JsonObject& json) override {
+        ConfigurationSection::patch(json);
+        loaded();
+    }
+
+    /**
+     * @brief Returns whether every key in the JSON is handled by an entry, and logs the ones that are not.
+     *
+     * Updates and patches received via MQTT are rejected if they are not valid,
+     * while unknown keys are ignored when loading the stored configuration.
+     */
+    bool validate(const JsonObject& json) const {
+        return ConfigurationSection::validate(json, name + " configuration");
+    }
+
+    /**
+     * @brief Registers a callback to be called whenever the configuration is loaded or updated.
+     *
+     * Prefer registering <code>onChange()</code> listeners on the individual properties and sections
+     * to only act on changes that are relevant.
+     */
     void onUpdate(const std::function<void()>& callback) {
         callbacks.push_back(callback);
     }
@@ -210,25 +845,62 @@ public:
         ConfigurationSection::store(json, inlineDefaults);
     }
 
+    /**
+     * @brief Returns the capacity needed to store the effective configuration.
+     */
+    size_t jsonCapacity() const override {
+        return ConfigurationSection::jsonCapacity();
+    }
+
+    /**
+     * @brief Describes the configuration as a JSON schema.
+     */
+    void describe(JsonObject& schema) const override {
+        schema["$schema"] = "https://json-schema.org/draft/2020-12/schema";
+        schema["title"] = name;
+        schema["type"] = "object";
+        JsonObject properties = schema.createNestedObject("properties");
+        ConfigurationSection::describe(properties);
+        schema["additionalProperties"] = false;
+    }
+
+    /**
+     * @brief Returns the capacity needed to describe the configuration via <code>describe()</code>.
+     */
+    size_t schemaCapacity() const override {
+        // $schema, title, type, properties and additionalProperties
+        return JSON_OBJECT_SIZE(5) + name.length() + 1 + ConfigurationSection::schemaCapacity();
+    }
+
 protected:
     void load(const JsonObject& json) override {
+        // Unknown keys in the stored configuration are only reported
+        validate(json);
         ConfigurationSection::load(json);
+        loaded();
+    }
+
+    void loadBinary(ConfigurationStore& store, const String& prefix) override {
+        ConfigurationSection::loadBinary(store, prefix);
+        loaded();
+    }
+
+    const String name;
 
+private:
+    void loaded() {
         // Print effective configuration
-        DynamicJsonDocument prettyJson(2048);
+        DynamicJsonDocument prettyJson(jsonCapacity());
         auto prettyRoot = prettyJson.to<JsonObject>();
         ConfigurationSection::store(prettyRoot, true);
         Serial.println("Effective " + name + " configuration:");
         serializeJsonPretty(prettyJson, Serial);
         Serial.println();
 
+        notifyChanges();
         updated();
     }
 
-    const String name;
-    const size_t capacity;
-
-private:
     void updated() {
         for (auto& callback : callbacks) {
             callback();
@@ -238,49 +910,276 @@ private:
     std::list<std::function<void()>> callbacks;
 };
 
-class FileConfiguration : public Configuration {
+/**
+ * @brief A JSON configuration file that survives being interrupted while writing.
+ *
+ * The configuration is written alternately to two slots next to the file (<code>path.a</code> and <code>path.b</code>).
+ * Each slot starts with a header holding a sequence number, the length and CRC32 of the JSON content,
+ * and the hash of the configuration update the content was derived from.
+ * A new configuration is always written to the inactive slot, and becomes active only once it's complete:
+ * if power is lost mid-write, the CRC won't match, and the previous slot is used instead.
+ *
+ * When neither slot is valid, the plain file at <code>path</code> is read (e.g. uploaded as part of the file system image).
+ */
+class ConfigurationFile {
 public:
-    FileConfiguration(const String& name, const String& path, size_t capacity = 2048)
-        : Configuration(name, capacity)
-        , path(path) {
+    ConfigurationFile(const String& path)
+        : path(path)
+        , slotPaths { path + ".a", path + ".b" } {
     }
 
-    void begin() {
-        DynamicJsonDocument json(capacity);
+    /**
+     * @brief Reads the most recent valid configuration, returns false if there is none.
+     *
+     * The document is replaced with a larger one if the configuration does not fit.
+     */
+    bool read(DynamicJsonDocument& json) {
+        // Only read the headers to find the newest slot
+        SlotHeader headers[2];
+        bool valid[2];
+        for (int slot = 0; slot < 2; slot++) {
+            valid[slot] = readHeader(slotPaths[slot], headers[slot]);
+            if (valid[slot]) {
+                // Continue from the highest sequence number even if that slot turns out to be corrupt
+                sequence = std::max(sequence, headers[slot].sequence);
+            }
+        }
+
+        int newest = valid[1] && (!valid[0] || headers[1].sequence > headers[0].sequence) ? 1 : 0;
+        for (int slot : { newest, 1 - newest }) {
+            if (!valid[slot]) {
+                continue;
+            }
+            if (readSlot(slotPaths[slot], headers[slot], json)) {
+                activeSlot = slot;
+                readFrom = slotPaths[slot];
+                sourceHash = headers[slot].sourceHash;
+                return true;
+            }
+            Serial.println("Configuration file " + slotPaths[slot] + " is corrupt, falling back to previous version");
+        }
+
         if (!SPIFFS.exists(path)) {
-            Serial.println("The " + name + " configuration file " + path + " was not found, falling back to defaults");
-        } else {
-            File file = SPIFFS.open(path, FILE_READ);
-            if (!file) {
-                fatalError("Cannot open config file " + path);
-                return;
+            return false;
+        }
+        File file = SPIFFS.open(path, FILE_READ);
+        if (!file) {
+            fatalError("Cannot open config file " + path);
+            return false;
+        }
+
+        DeserializationError error = deserializeGrowing(json, file, 0);
+        file.close();
+        if (error) {
+            Serial.println(file.readString());
+            fatalError("Failed to read config file " + path + ": " + String(error.c_str()));
+            return false;
+        }
+        readFrom = path;
+        sourceHash = JsonHasher::hash(json);
+        return true;
+    }
+
+    /**
+     * @brief Writes the configuration to the inactive slot, then makes it the active one.
+     *
+     * @param sourceHash the hash of the configuration update the content was derived from,
+     *   which differs from the hash of the content once patches are applied.
+     */
+    void write(const JsonObject& json, uint64_t sourceHash) {
+        size_t length = measureJson(json);
+        std::unique_ptr<char[]> buffer(new char[length + 1]);
+        serializeJson(json, buffer.get(), length + 1);
+
+        SlotHeader header;
+        header.magic = SLOT_MAGIC;
+        header.sequence = sequence + 1;
+        header.length = length;
+        header.crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(buffer.get()), length);
+        header.sourceHash = sourceHash;
+
+        int slot = activeSlot == 0 ? 1 : 0;
+        File file = SPIFFS.open(slotPaths[slot], FILE_WRITE);
+        if (!file) {
+            fatalError("Cannot open config file " + slotPaths[slot]);
+            return;
+        }
+        file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const uint8_t*>(buffer.get()), length);
+        file.flush();
+        file.close();
+
+        activeSlot = slot;
+        sequence = header.sequence;
+        this->sourceHash = sourceHash;
+
+        // The plain file is superseded by the slots
+        if (SPIFFS.exists(path)) {
+            SPIFFS.remove(path);
+        }
+    }
+
+    /**
+     * @brief The file the configuration was last read from.
+     */
+    const String& getReadFrom() const {
+        return readFrom;
+    }
+
+    /**
+     * @brief The hash of the configuration update the current content was derived from.
+     */
+    uint64_t getSourceHash() const {
+        return sourceHash;
+    }
+
+private:
+    struct SlotHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t length;
+        uint32_t crc;
+        uint64_t sourceHash;
+    };
+
+    // "FHCF" in little endian
+    static const uint32_t SLOT_MAGIC = 0x46434846;
+
+    static bool readHeader(const String& slotPath, SlotHeader& header) {
+        if (!SPIFFS.exists(slotPath)) {
+            return false;
+        }
+        File file = SPIFFS.open(slotPath, FILE_READ);
+        if (!file) {
+            return false;
+        }
+        bool valid = file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+            && header.magic == SLOT_MAGIC
+            && file.size() == sizeof(header) + header.length;
+        file.close();
+        return valid;
+    }
+
+    static bool readSlot(const String& slotPath, const SlotHeader& header, DynamicJsonDocument& json) {
+        File file = SPIFFS.open(slotPath, FILE_READ);
+        if (!file) {
+            return false;
+        }
+
+        file.seek(sizeof(header));
+        uint32_t crc = 0;
+        uint8_t buffer[256];
+        while (true) {
+            size_t read = file.read(buffer, sizeof(buffer));
+            if (read == 0) {
+                break;
             }
+            crc = esp_rom_crc32_le(crc, buffer, read);
+        }
+        if (crc != header.crc) {
+            file.close();
+            return false;
+        }
+
+        DeserializationError error = deserializeGrowing(json, file, sizeof(header));
+        file.close();
+        if (error) {
+            Serial.println("Failed to read config file " + slotPath + ": " + String(error.c_str()));
+            return false;
+        }
+        return true;
+    }
 
+    /**
+     * @brief Deserializes the JSON starting at the given position, doubling the capacity of the document for as long as it runs out of memory.
+     */
+    static DeserializationError deserializeGrowing(DynamicJsonDocument& json, File& file, size_t position) {
+        size_t capacity = json.capacity();
+        while (true) {
+            file.seek(position);
             DeserializationError error = deserializeJson(json, file);
-            file.close();
-            if (error) {
-                Serial.println(file.readString());
-                fatalError("Failed to read config file " + path + ": " + String(error.c_str()));
-                return;
+            if (error != DeserializationError::NoMemory) {
+                return error;
+            }
+            capacity = std::max(capacity * 2, (size_t) JSON_OBJECT_SIZE(8));
+            if (capacity > MAX_CAPACITY) {
+                return error;
             }
+            json = DynamicJsonDocument(capacity);
+        }
+    }
+
+    // Give up on configurations larger than this rather than running out of heap
+    static const size_t MAX_CAPACITY = 32 * 1024;
+
+    const String path;
+    const String slotPaths[2];
+    int activeSlot = -1;
+    uint32_t sequence = 0;
+    String readFrom;
+    uint64_t sourceHash = 0;
+};
+
+class FileConfiguration : public Configuration {
+public:
+    FileConfiguration(const String& name, const String& path)
+        : Configuration(name)
+        , file(path) {
+    }
+
+    void begin() {
+        auto startTime = micros();
+        // Enough for the known entries with their default values; the document grows if stored values are larger
+        DynamicJsonDocument json(jsonCapacity());
+        if (file.read(json)) {
+            contentHash = file.getSourceHash();
+            Serial.printf("Loaded %s configuration from %s in %lu us\n",
+                name.c_str(), file.getReadFrom().c_str(), micros() - startTime);
+        } else {
+            Serial.println("The " + name + " configuration file was not found, falling back to defaults");
         }
         load(json.as<JsonObject>());
     }
 
+    /**
+     * @brief Updates the configuration, unless the content is the same as what we have stored.
+     *
+     * Retained configuration is redelivered on every connect, so most updates are
+     * identical to the stored configuration. Skipping those saves reloading properties,
+     * notifying listeners, and wearing the flash by rewriting the file.
+     */
     void update(const JsonObject& json) override {
-        Configuration::update(json);
-        File file = SPIFFS.open(path, FILE_WRITE);
-        if (!file) {
-            fatalError("Cannot open config file " + path);
+        uint64_t hash = JsonHasher::hash(json);
+        if (hash == contentHash) {
+            Serial.println("The " + name + " configuration is unchanged, skipping update");
             return;
         }
+        Configuration::update(json);
+        contentHash = hash;
+        file.write(json, contentHash);
+    }
 
-        serializeJson(json, file);
-        file.close();
+    /**
+     * @brief Patches the configuration, and stores the patched file.
+     *
+     * The stored content is patched as well, so that secrets and keys we don't know about are preserved.
+     */
+    void patch(const JsonObject& json) override {
+        DynamicJsonDocument merged(jsonCapacity() + jsonCapacityOf(json));
+        if (!file.read(merged)) {
+            merged.to<JsonObject>();
+        }
+        applyMergePatch(merged.as<JsonVariant>(), json);
+        Configuration::patch(json);
+        // Keep the hash of the update we are based on, so that redelivering the same retained configuration does not undo the patch
+        file.write(merged.as<JsonObject>(), contentHash);
     }
 
 private:
-    const String path;
+    ConfigurationFile file;
+
+    // Hash of the last configuration update applied (patches do not change it), zero if nothing is stored
+    uint64_t contentHash = 0;
 };
 
 }}    // namespace farmhub::client
@@ -17,9 +17,11 @@ public:
     }
 
     bool publishEvent(const String& event, std::function<void(JsonObject&)> populateEvent, bool skipTelemetry = false) {
-        bool result = mqtt.publish("events/" + event, [populateEvent](JsonObject& json) {
-            populateEvent(json);
-        });
+        bool result = mqtt.publish(
+            "events/" + event, [populateEvent](JsonObject& json) {
+                populateEvent(json);
+            },
+            MqttHandler::Retention::NoRetain, MqttHandler::QoS::AtMostOnce, MqttHandler::Timestamp::Include);
         if (!skipTelemetry) {
             telemetryPublisher.publish();
         }
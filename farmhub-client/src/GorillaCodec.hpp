@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <TimeSeries.hpp>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Writes bits MSB-first into a fixed-size buffer.
+ */
+class BitWriter {
+public:
+    BitWriter(uint8_t* buffer, size_t capacity)
+        : buffer(buffer)
+        , capacity(capacity) {
+    }
+
+    /**
+     * @brief Writes the lowest <code>count</code> bits of <code>value</code>, returns false if the buffer is full.
+     */
+    bool write(uint32_t value, uint8_t count) {
+        if (position + count > capacity * 8) {
+            return false;
+        }
+        for (int bit = count - 1; bit >= 0; bit--) {
+            size_t index = position / 8;
+            uint8_t mask = 0x80 >> (position % 8);
+            if ((value >> bit) & 1) {
+                buffer[index] |= mask;
+            } else {
+                buffer[index] &= ~mask;
+            }
+            position++;
+        }
+        return true;
+    }
+
+    size_t getPosition() const {
+        return position;
+    }
+
+    void rewind(size_t position) {
+        this->position = position;
+    }
+
+private:
+    uint8_t* const buffer;
+    const size_t capacity;
+    size_t position = 0;
+};
+
+/**
+ * @brief Reads bits MSB-first from a buffer written by <code>BitWriter</code>.
+ */
+class BitReader {
+public:
+    BitReader(const uint8_t* buffer, size_t capacity)
+        : buffer(buffer)
+        , capacity(capacity) {
+    }
+
+    bool read(uint32_t& value, uint8_t count) {
+        if (position + count > capacity * 8) {
+            return false;
+        }
+        value = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            value = (value << 1) | ((buffer[position / 8] >> (7 - position % 8)) & 1);
+            position++;
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* const buffer;
+    const size_t capacity;
+    size_t position = 0;
+};
+
+/**
+ * @brief Compresses samples into a fixed-size buffer the way Facebook's Gorilla does.
+ *
+ * Timestamps are stored as the difference between consecutive deltas, which is zero (a single bit)
+ * when samples arrive at a steady interval. Values are XOR-ed with the previous value, and only the
+ * bits that differ are stored, which takes a single bit when the value has not changed.
+ *
+ * See <a href="https://www.vldb.org/pvldb/vol8/p1816-teller.pdf">Gorilla: A Fast, Scalable, In-Memory Time Series Database</a>.
+ */
+class GorillaEncoder {
+public:
+    GorillaEncoder(uint8_t* buffer, size_t capacity)
+        : writer(buffer, capacity) {
+    }
+
+    /**
+     * @brief Appends a sample, and returns false without storing anything if it does not fit.
+     *
+     * Timestamps must not decrease.
+     */
+    bool append(uint32_t time, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        State saved = state;
+        size_t savedPosition = writer.getPosition();
+        bool written = count == 0
+            ? writer.write(time, 32) && writer.write(bits, 32)
+            : appendTime(time) && appendValue(bits);
+        if (!written) {
+            state = saved;
+            writer.rewind(savedPosition);
+            return false;
+        }
+        state.lastTime = time;
+        state.lastBits = bits;
+        count++;
+        return true;
+    }
+
+    size_t getCount() const {
+        return count;
+    }
+
+    /**
+     * @brief The number of bytes used in the buffer.
+     */
+    size_t getSize() const {
+        return (writer.getPosition() + 7) / 8;
+    }
+
+private:
+    bool appendTime(uint32_t time) {
+        int32_t delta = time - state.lastTime;
+        int32_t deltaOfDelta = delta - state.lastDelta;
+        state.lastDelta = delta;
+        if (deltaOfDelta == 0) {
+            return writer.write(0b0, 1);
+        } else if (deltaOfDelta >= -64 && deltaOfDelta < 64) {
+            return writer.write(0b10, 2) && writer.write(deltaOfDelta, 7);
+        } else if (deltaOfDelta >= -256 && deltaOfDelta < 256) {
+            return writer.write(0b110, 3) && writer.write(deltaOfDelta, 9);
+        } else if (deltaOfDelta >= -2048 && deltaOfDelta < 2048) {
+            return writer.write(0b1110, 4) && writer.write(deltaOfDelta, 12);
+        } else {
+            return writer.write(0b1111, 4) && writer.write(deltaOfDelta, 32);
+        }
+    }
+
+    bool appendValue(uint32_t bits) {
+        uint32_t xored = bits ^ state.lastBits;
+        if (xored == 0) {
+            return writer.write(0b0, 1);
+        }
+        uint8_t leading = __builtin_clz(xored);
+        uint8_t trailing = __builtin_ctz(xored);
+        if (state.lastMeaningful > 0 && leading >= state.lastLeading && trailing >= state.lastTrailing) {
+            // Fits in the window of the previous value
+            uint8_t meaningful = 32 - state.lastLeading - state.lastTrailing;
+            return writer.write(0b10, 2)
+                && writer.write(xored >> state.lastTrailing, meaningful);
+        }
+        uint8_t meaningful = 32 - leading - trailing;
+        state.lastLeading = leading;
+        state.lastTrailing = trailing;
+        state.lastMeaningful = meaningful;
+        return writer.write(0b11, 2)
+            && writer.write(leading, 5)
+            // 1-32 meaningful bits stored as 0-31
+            && writer.write(meaningful - 1, 5)
+            && writer.write(xored >> trailing, meaningful);
+    }
+
+    struct State {
+        uint32_t lastTime = 0;
+        int32_t lastDelta = 0;
+        uint32_t lastBits = 0;
+        uint8_t lastLeading = 0;
+        uint8_t lastTrailing = 0;
+        uint8_t lastMeaningful = 0;
+    };
+
+    BitWriter writer;
+    State state;
+    size_t count = 0;
+};
+
+/**
+ * @brief Decodes samples written by <code>GorillaEncoder</code>.
+ */
+class GorillaDecoder {
+public:
+    /**
+     * @param count the number of samples in the buffer, see <code>GorillaEncoder::getCount()</code>.
+     */
+    GorillaDecoder(const uint8_t* buffer, size_t size, size_t count)
+        : reader(buffer, size)
+        , remaining(count) {
+    }
+
+    /**
+     * @brief Decodes the next sample, returns false if there are no more samples.
+     */
+    bool next(RawSample& sample) {
+        if (remaining == 0) {
+            return false;
+        }
+        bool read = first
+            ? reader.read(lastTime, 32) && reader.read(lastBits, 32)
+            : readTime() && readValue();
+        if (!read) {
+            remaining = 0;
+            return false;
+        }
+        first = false;
+        remaining--;
+        sample.time = lastTime;
+        memcpy(&sample.value, &lastBits, sizeof(sample.value));
+        return true;
+    }
+
+private:
+    bool readTime() {
+        uint32_t bit;
+        uint8_t prefix = 0;
+        while (prefix < 4) {
+            if (!reader.read(bit, 1)) {
+                return false;
+            }
+            if (bit == 0) {
+                break;
+            }
+            prefix++;
+        }
+        static const uint8_t widths[] = { 0, 7, 9, 12, 32 };
+        uint8_t width = widths[prefix];
+        int32_t deltaOfDelta = 0;
+        if (width > 0) {
+            uint32_t raw;
+            if (!reader.read(raw, width)) {
+                return false;
+            }
+            // Sign-extend
+            deltaOfDelta = width == 32
+                ? static_cast<int32_t>(raw)
+                : static_cast<int32_t>(raw << (32 - width)) >> (32 - width);
+        }
+        lastDelta += deltaOfDelta;
+        lastTime += lastDelta;
+        return true;
+    }
+
+    bool readValue() {
+        uint32_t bit;
+        if (!reader.read(bit, 1)) {
+            return false;
+        }
+        if (bit == 0) {
+            return true;
+        }
+        if (!reader.read(bit, 1)) {
+            return false;
+        }
+        if (bit == 1) {
+            uint32_t leading, meaningful;
+            if (!reader.read(leading, 5) || !reader.read(meaningful, 5)) {
+                return false;
+            }
+            lastLeading = leading;
+            lastTrailing = 32 - leading - (meaningful + 1);
+        }
+        uint32_t xored;
+        if (!reader.read(xored, 32 - lastLeading - lastTrailing)) {
+            return false;
+        }
+        lastBits ^= xored << lastTrailing;
+        return true;
+    }
+
+    BitReader reader;
+    size_t remaining;
+    bool first = true;
+    uint32_t lastTime = 0;
+    int32_t lastDelta = 0;
+    uint32_t lastBits = 0;
+    uint8_t lastLeading = 0;
+    uint8_t lastTrailing = 0;
+};
+
+}}    // namespace farmhub::client
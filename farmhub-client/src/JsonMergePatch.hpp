@@ -0,0 +1,38 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Applies a JSON merge patch (RFC 7386) to the target.
+ *
+ * Members of the patch replace the corresponding members of the target, <code>null</code> members
+ * remove them, and nested objects are merged recursively. A patch that is not an object
+ * replaces the target as a whole.
+ */
+inline void applyMergePatch(JsonVariant target, JsonVariantConst patch) {
+    if (!patch.is<JsonObjectConst>()) {
+        target.set(patch);
+        return;
+    }
+    JsonObject object = target.is<JsonObject>()
+        ? target.as<JsonObject>()
+        : target.to<JsonObject>();
+    for (JsonPairConst member : patch.as<JsonObjectConst>()) {
+        JsonVariantConst value = member.value();
+        if (value.isNull()) {
+            object.remove(member.key());
+        } else if (value.is<JsonObjectConst>()) {
+            JsonVariant existing = object[member.key()];
+            JsonObject nested = existing.is<JsonObject>()
+                ? existing.as<JsonObject>()
+                : object.createNestedObject(member.key());
+            applyMergePatch(nested, value);
+        } else {
+            object[member.key()] = value;
+        }
+    }
+}
+
+}}    // namespace farmhub::client
@@ -1,18 +1,20 @@
 #pragma once
 
 #include <ArduinoJson.h>
-#include <CircularBuffer.h>
 #include <Client.h>
 #include <MQTT.h>
 #include <WiFi.h>
 #include <chrono>
 #include <functional>
-#include <list>
+#include <string>
 
 #include <Configuration.hpp>
 #include <MdnsHandler.hpp>
+#include <MqttSession.hpp>
+#include <PowerManager.hpp>
 #include <Sleep.hpp>
 #include <Task.hpp>
+#include <WallClock.hpp>
 
 #define MQTT_BUFFER_SIZE 2048
 #define MQTT_QUEUED_MESSAGES_MAX 16
@@ -23,6 +25,113 @@ using namespace std::chrono;
 
 namespace farmhub { namespace client {
 
+/**
+ * @brief Connects to the broker via arduino-mqtt, looking up its address via mDNS.
+ */
+class ArduinoMqttClient : public MqttClient {
+public:
+    ArduinoMqttClient(MdnsHandler& mdns)
+        : mdns(mdns)
+        , mqttClient(MQTT_BUFFER_SIZE) {
+    }
+
+    void begin(const String& hostname, const int port) {
+        this->hostname = hostname;
+        this->port = port;
+
+        mqttClient.setKeepAlive(180);
+        mqttClient.setCleanSession(true);
+        mqttClient.setTimeout(MQTT_TIMEOUT);
+        mqttClient.begin(client);
+    }
+
+    bool connect(const std::string& clientId) override {
+        // Lookup host name via MDNS explicitly
+        // See https://github.com/kivancsikert/chicken-coop-door/issues/128
+        if (hostname.isEmpty()) {
+            bool found = mdns.withService(
+                "mqtt", "tcp",
+                [&](const String& hostname, const IPAddress& address, uint16_t port) {
+                    Serial.print("Connecting to MQTT broker at " + address.toString() + ":" + String(port));
+                    mqttClient.setHost(address, port);
+                });
+
+            if (!found) {
+                Serial.println("No MQTT services found via mDNS");
+                return false;
+            }
+        } else {
+            bool found = mdns.withHost(hostname, [&](const IPAddress& address) {
+                Serial.print("Connecting to MQTT broker at " + address.toString() + ":" + String(port));
+                mqttClient.setHost(address, port);
+            });
+            if (!found) {
+                return false;
+            }
+        }
+        Serial.print("...");
+
+        if (!mqttClient.connect(clientId.c_str())) {
+            Serial.printf(" failed, error = %d (check lwmqtt_err_t), return code = %d (check lwmqtt_return_code_t)\n",
+                mqttClient.lastError(), mqttClient.returnCode());
+            return false;
+        }
+        Serial.println(" connected");
+        return true;
+    }
+
+    void disconnect() override {
+        mqttClient.disconnect();
+    }
+
+    bool connected() override {
+        return mqttClient.connected();
+    }
+
+    bool publish(const std::string& topic, const std::string& payload, bool retain, int qos) override {
+        bool success = mqttClient.publish(topic.c_str(), payload.c_str(), payload.length(), retain, qos);
+#ifdef DUMP_MQTT
+        Serial.printf("Published to '%s' (size: %d)\n", topic.c_str(), payload.length());
+#endif
+        if (!success) {
+            Serial.printf("Error publishing to MQTT topic at '%s', error = %d\n",
+                topic.c_str(), mqttClient.lastError());
+        }
+        return success;
+    }
+
+    bool subscribe(const std::string& topic, int qos) override {
+        Serial.printf("Subscribing to MQTT topic '%s' with QOS = %d\n", topic.c_str(), qos);
+        bool success = mqttClient.subscribe(topic.c_str(), qos);
+        if (!success) {
+            Serial.printf("Error subscribing to MQTT topic '%s', error = %d\n",
+                topic.c_str(), mqttClient.lastError());
+        }
+        return success;
+    }
+
+    void onMessage(std::function<void(const std::string& topic, const std::string& payload)> handler) override {
+        mqttClient.onMessage([handler](String& topic, String& payload) {
+#ifdef DUMP_MQTT
+            Serial.println("Received '" + topic + "' (size: " + payload.length() + "): " + payload);
+#endif
+            handler(std::string(topic.c_str(), topic.length()), std::string(payload.c_str(), payload.length()));
+        });
+    }
+
+    void loop() override {
+        mqttClient.loop();
+    }
+
+private:
+    MdnsHandler& mdns;
+    String hostname;
+    int port;
+
+    WiFiClient client;
+    MQTTClient mqttClient;
+};
+
 class MqttHandler
     : public BaseTask,
       public BaseSleepListener {
@@ -44,75 +153,76 @@ public:
         Retain
     };
 
+    /**
+     * @brief Whether to add the time the message was queued as <code>timestamp</code> (milliseconds since the UNIX epoch).
+     */
+    enum class Timestamp {
+        Omit,
+        Include
+    };
+
     enum class QoS {
         AtMostOnce = 0,
         AtLeastOnce = 1,
         ExactlyOnce = 2
     };
 
+    typedef MqttSession<boot_clock, MQTT_QUEUED_MESSAGES_MAX> Session;
+    typedef MqttTimingStats TimingStats;
+    typedef Session::Metrics Metrics;
+
     MqttHandler(TaskContainer& tasks, MdnsHandler& mdns, SleepHandler& sleep, Configuration& appConfig)
         : BaseTask(tasks, "MQTT")
         , BaseSleepListener(sleep)
-        , mqttClient(MQTT_BUFFER_SIZE)
-        , mdns(mdns)
+        , mqttClient(mdns)
         , appConfig(appConfig) {
     }
 
     void begin(const String& hostname, const int port, const String& clientId, const String& topic) {
-        this->hostname = hostname;
-        this->port = port;
-        this->clientId = clientId;
         this->topic = topic;
 
         Serial.printf("MQTT client ID is '%s', topic prefix is '%s'\n",
             clientId.c_str(), topic.c_str());
 
-        String appConfigTopic = topic + "/config";
-        String commandTopicPrefix = topic + "/commands/";
-
-        mqttClient.setKeepAlive(180);
-        mqttClient.setCleanSession(true);
-        mqttClient.setTimeout(MQTT_TIMEOUT);
-        mqttClient.onMessage([&, appConfigTopic, commandTopicPrefix](String& topic, String& payload) {
-#ifdef DUMP_MQTT
-            Serial.println("Received '" + topic + "' (size: " + payload.length() + "): " + payload);
-#endif
+        mqttClient.begin(hostname, port);
+        session.onConfig([&](const std::string& payload) {
             DynamicJsonDocument json(payload.length() * 2);
             deserializeJson(json, payload);
-            if (topic == appConfigTopic) {
-                appConfig.update(json.as<JsonObject>());
-            } else if (topic.startsWith(commandTopicPrefix)) {
-                if (payload.isEmpty()) {
-#ifdef DUMP_MQTT
-                    Serial.println("Ignoring empty payload");
-#endif
-                    return;
-                }
-                auto command = topic.substring(commandTopicPrefix.length());
-                Serial.printf("Received command '%s'\n", command.c_str());
-                for (auto handler : commandHandlers) {
-                    if (handler.command == command) {
-                        // Clear command topic
-                        mqttClient.publish(topic, "", true, 0);
-                        auto request = json.as<JsonObject>();
-                        DynamicJsonDocument responseDoc(2048);
-                        auto response = responseDoc.to<JsonObject>();
-                        handler.handle(request, response);
-                        if (response.size() > 0) {
-                            publish("responses/" + command, responseDoc, Retention::NoRetain, QoS::ExactlyOnce);
-                        }
-                        return;
-                    }
-                }
-                Serial.printf("Unknown command: '%s'\n", command.c_str());
-            } else {
-                Serial.printf("Unknown topic: '%s'\n", topic.c_str());
+            if (!appConfig.validate(json.as<JsonObject>())) {
+                Serial.println("Rejecting configuration with unknown keys");
+                return false;
             }
+            appConfig.update(json.as<JsonObject>());
+            return true;
         });
-        mqttClient.begin(client);
+        session.onConfigPatch([&](const std::string& payload) {
+            DynamicJsonDocument json(payload.length() * 2);
+            deserializeJson(json, payload);
+            if (!json.is<JsonObject>()) {
+                Serial.println("Rejecting configuration patch that is not a JSON object");
+                return false;
+            }
+            if (!appConfig.validate(json.as<JsonObject>())) {
+                Serial.println("Rejecting configuration patch with unknown keys");
+                return false;
+            }
+            appConfig.patch(json.as<JsonObject>());
+            return true;
+        });
+        session.onUnknownMessage([](const std::string& topic) {
+            Serial.printf("Unknown topic or command: '%s'\n", topic.c_str());
+        });
+        session.onTimestamp(WallClock::toUtcMillis);
+        session.begin(clientId.c_str(), topic.c_str());
     }
 
-    bool publish(const String& suffix, const JsonDocument& json, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce) {
+    /**
+     * @brief Queues a message to be published once connected.
+     *
+     * @param onPublished called after the message has been sent, and acknowledged by the broker for QoS above zero;
+     *     not called if the message is dropped or fails to publish.
+     */
+    bool publish(const String& suffix, const JsonDocument& json, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce, Timestamp timestamp = Timestamp::Omit, std::function<void()> onPublished = nullptr) {
         String fullTopic = topic + "/" + suffix;
 #ifdef DUMP_MQTT
         Serial.printf("Queuing MQTT topic '%s'%s (qos = %d): ",
@@ -120,61 +230,77 @@ public:
         serializeJsonPretty(json, Serial);
         Serial.println();
 #endif
-        bool storedWithoutDropping = publishQueue.unshift(MqttMessage(fullTopic, json, retain, qos));
+        Session::Message message;
+        message.topic = fullTopic.c_str();
+        serializeJson(json, message.payload);
+        message.retain = retain == Retention::Retain;
+        message.qos = static_cast<int>(qos);
+        if (timestamp == Timestamp::Include) {
+            message.capturedAt = boot_clock::now();
+        }
+        message.onPublished = onPublished;
+        bool storedWithoutDropping = session.publish(std::move(message));
         if (!storedWithoutDropping) {
             Serial.println("Overflow in publish queue, dropping message");
         }
         return storedWithoutDropping;
     }
 
-    bool publish(const String& suffix, std::function<void(JsonObject&)> populate, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce, int size = MQTT_BUFFER_SIZE) {
+    bool publish(const String& suffix, std::function<void(JsonObject&)> populate, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce, Timestamp timestamp = Timestamp::Omit, int size = MQTT_BUFFER_SIZE) {
         DynamicJsonDocument doc(size);
         JsonObject root = doc.to<JsonObject>();
         populate(root);
-        return publish(suffix, doc, retain, qos);
+        return publish(suffix, doc, retain, qos, timestamp);
     }
 
     void flush() {
-        while (!publishQueue.isEmpty()) {
-            const MqttMessage& message = publishQueue.pop();
-            bool success = mqttClient.publish(message.topic, message.payload, message.retain == Retention::Retain, static_cast<int>(message.qos));
-#ifdef DUMP_MQTT
-            Serial.printf("Published to '%s' (size: %d)\n", message.topic.c_str(), message.payload.length());
-#endif
-            if (!success) {
-                Serial.printf("Error publishing to MQTT topic at '%s', error = %d\n",
-                    message.topic.c_str(), mqttClient.lastError());
-            }
+        if (session.queuedMessages() == 0) {
+            return;
         }
+        // Serializing and sending messages is CPU bound
+        PowerLockGuard lock(flushLock);
+        session.flush();
     }
 
     bool subscribe(const String& suffix, QoS qos) {
-        if (!mqttClient.connected()) {
-            return false;
-        }
-        String fullTopic = topic + "/" + suffix;
-        Serial.printf("Subscribing to MQTT topic '%s' with QOS = %d\n", fullTopic.c_str(), qos);
-        bool success = mqttClient.subscribe(fullTopic.c_str(), static_cast<int>(qos));
-        if (!success) {
-            Serial.printf("Error subscribing to MQTT topic '%s', error = %d\n",
-                fullTopic.c_str(), mqttClient.lastError());
-        }
-        return success;
+        return session.subscribe(suffix.c_str(), static_cast<int>(qos));
     }
 
     void registerCommand(const String command, std::function<void(const JsonObject&, JsonObject&)> handle) {
-        commandHandlers.emplace_back(command, handle);
+        registerCommand(command, handle, [](const JsonObject&) -> size_t {
+            return MQTT_BUFFER_SIZE;
+        });
     }
 
     class Command {
     public:
         virtual void handle(const JsonObject& request, JsonObject& response) = 0;
+
+        /**
+         * @brief Returns the capacity of the response document needed to handle the given request.
+         */
+        virtual size_t responseCapacity(const JsonObject& request) {
+            return MQTT_BUFFER_SIZE;
+        }
     };
 
     void registerCommand(const String command, Command& handler) {
-        registerCommand(command, [&](const JsonObject& request, JsonObject& response) {
-            handler.handle(request, response);
-        });
+        registerCommand(
+            command,
+            [&](const JsonObject& request, JsonObject& response) {
+                handler.handle(request, response);
+            },
+            [&](const JsonObject& request) {
+                return handler.responseCapacity(request);
+            });
+    }
+
+    const Metrics& getMetrics() const {
+        return session.getMetrics();
+    }
+
+    void resetMetrics() {
+        session.resetMetrics();
     }
 
 protected:
@@ -184,123 +310,52 @@ protected:
             return sleepFor(seconds { 1 });
         }
 
-        if (!mqttClient.connected()) {
-            if (!tryConnect()) {
-                // Try connecting again in 10 seconds
-                return sleepFor(seconds { 10 });
-            }
+        if (!session.connect()) {
+            // Try connecting again in 10 seconds
+            return sleepFor(seconds { 10 });
         }
 
         flush();
 
-        mqttClient.loop();
+        session.loop();
         // TODO We could repeat sooner if we couldn't publish everything
         return sleepFor(milliseconds { MQTT_POLL_FREQUENCY });
     }
 
     virtual void onDeepSleep(SleepEvent& event) override {
         auto duration = event.duration;
-        publish("sleep", [duration](JsonObject json) {
-            json["duration"] = duration_cast<seconds>(duration).count();
-        });
+        publish(
+            "sleep", [duration](JsonObject json) {
+                json["duration"] = duration_cast<seconds>(duration).count();
+            },
+            Retention::NoRetain, QoS::AtMostOnce, Timestamp::Include, JSON_OBJECT_SIZE(1));
         flush();
     }
 
 private:
-    bool tryConnect() {
-        // Lookup host name via MDNS explicitly
-        // See https://github.com/kivancsikert/chicken-coop-door/issues/128
-        if (hostname.isEmpty()) {
-            bool found = mdns.withService(
-                "mqtt", "tcp",
-                [&](const String& hostname, const IPAddress& address, uint16_t port) {
-                    Serial.print("Connecting to MQTT broker at " + address.toString() + ":" + String(port));
-                    mqttClient.setHost(address, port);
-                });
-
-            if (!found) {
-                Serial.println("No MQTT services found via mDNS");
-                return false;
-            }
-        } else {
-            bool found = mdns.withHost(hostname, [&](const IPAddress& address) {
-                Serial.print("Connecting to MQTT broker at " + address.toString() + ":" + String(port));
-                mqttClient.setHost(address, port);
-            });
-            if (!found) {
-                return false;
+    void registerCommand(const String& command, std::function<void(const JsonObject&, JsonObject&)> handle, std::function<size_t(const JsonObject&)> responseCapacity) {
+        session.registerCommand(command.c_str(), [command, handle, responseCapacity](const std::string& payload, std::string& responsePayload) {
+            Serial.printf("Received command '%s'\n", command.c_str());
+            DynamicJsonDocument json(payload.length() * 2);
+            deserializeJson(json, payload);
+            auto request = json.as<JsonObject>();
+            DynamicJsonDocument responseDoc(responseCapacity(request));
+            auto response = responseDoc.to<JsonObject>();
+            handle(request, response);
+            if (response.size() > 0) {
+                serializeJson(responseDoc, responsePayload);
             }
-        }
-        Serial.print("...");
-
-        bool result = mqttClient.connect(clientId.c_str());
-
-        if (!result) {
-            Serial.printf(" failed, error = %d (check lwmqtt_err_t), return code = %d (check lwmqtt_return_code_t)\n",
-                mqttClient.lastError(), mqttClient.returnCode());
-
-            // Clean up the client
-            mqttClient.disconnect();
-            return false;
-        }
-
-        // We're now connected
-        Serial.println(" connected");
-
-        // Set QoS to 1 (ack) for configuration messages
-        subscribe("config", QoS::ExactlyOnce);
-        // QoS 0 (no ack) for commands
-        subscribe("commands/#", QoS::ExactlyOnce);
-        return true;
+        });
     }
 
-    String hostname;
-    int port;
-    String clientId;
     String topic;
 
-    WiFiClient client;
-    MQTTClient mqttClient;
+    ArduinoMqttClient mqttClient;
+    Session session { mqttClient };
 
-    MdnsHandler& mdns;
     Configuration& appConfig;
 
-    bool connecting = false;
-
-    struct CommandHandler {
-        CommandHandler(const String& command, std::function<void(const JsonObject&, JsonObject&)> handle)
-            : command(command)
-            , handle(handle) {
-        }
-
-        const String command;
-        const std::function<void(const JsonObject&, JsonObject&)> handle;
-    };
-
-    std::list<CommandHandler> commandHandlers;
-
-    struct MqttMessage {
-        MqttMessage()
-            : topic("")
-            , payload("")
-            , retain(Retention::NoRetain)
-            , qos(QoS::AtMostOnce) {
-        }
-
-        MqttMessage(const String& topic, const JsonDocument& payload, Retention retain, QoS qos)
-            : topic(topic)
-            , retain(retain)
-            , qos(qos) {
-            serializeJson(payload, this->payload);
-        }
-
-        String topic;
-        String payload;
-        Retention retain;
-        QoS qos;
-    };
-
-    CircularBuffer<MqttMessage, MQTT_QUEUED_MESSAGES_MAX> publishQueue;
+    PowerLock flushLock { "mqtt-flush" };
 };
 
 }}    // namespace farmhub::client
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief A fixed-size queue of messages waiting to be published, dropping the oldest message when full.
+ *
+ * The queue does not know about the MQTT client, so that queueing and flushing
+ * can be exercised and benchmarked on the host against a stand-in for the broker.
+ *
+ * @tparam Message the queued message, must be default constructible.
+ * @tparam Capacity the maximum number of messages kept.
+ */
+template <typename Message, size_t Capacity>
+class MqttPublishQueue {
+public:
+    struct FlushResult {
+        size_t published;
+        size_t failed;
+    };
+
+    /**
+     * @brief Adds a message to the end of the queue.
+     *
+     * @return false if the oldest message had to be dropped to make room.
+     */
+    bool push(Message message) {
+        bool dropped = count == Capacity;
+        if (dropped) {
+            head = (head + 1) % Capacity;
+            count--;
+        }
+        messages[(head + count) % Capacity] = std::move(message);
+        count++;
+        return !dropped;
+    }
+
+    /**
+     * @brief Removes every message from the queue in order, and publishes it via the given function.
+     *
+     * A message is removed even if it fails to publish.
+     *
+     * @param publish called with each message, returns whether it was published.
+     */
+    template <typename Publish>
+    FlushResult flush(Publish publish) {
+        FlushResult result { 0, 0 };
+        while (count > 0) {
+            Message message = std::move(messages[head]);
+            messages[head] = Message();
+            head = (head + 1) % Capacity;
+            count--;
+            if (publish(message)) {
+                result.published++;
+            } else {
+                result.failed++;
+            }
+        }
+        return result;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+private:
+    Message messages[Capacity];
+    size_t head = 0;
+    size_t count = 0;
+};
+
+}}    // namespace farmhub::client
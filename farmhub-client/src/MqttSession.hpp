@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <string>
+
+#include <MqttPublishQueue.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief The connection to the MQTT broker used by <code>MqttSession</code>.
+ *
+ * Implemented on top of arduino-mqtt on the device, and by a loopback stand-in for the broker in tests.
+ */
+class MqttClient {
+public:
+    virtual bool connect(const std::string& clientId) = 0;
+    virtual void disconnect() = 0;
+    virtual bool connected() = 0;
+    virtual bool publish(const std::string& topic, const std::string& payload, bool retain, int qos) = 0;
+    virtual bool subscribe(const std::string& topic, int qos) = 0;
+
+    /**
+     * @brief Sets the handler incoming messages are passed to by <code>loop()</code>.
+     */
+    virtual void onMessage(std::function<void(const std::string& topic, const std::string& payload)> handler) = 0;
+
+    /**
+     * @brief Sends keep-alives, and receives incoming messages.
+     */
+    virtual void loop() = 0;
+};
+
+/**
+ * @brief Timing statistics of a recurring operation.
+ */
+struct MqttTimingStats {
+    void record(microseconds duration) {
+        count++;
+        last = duration;
+        total += duration;
+        max = std::max(max, duration);
+    }
+
+    template <typename Json>
+    void populate(Json json) const {
+        json["count"] = count;
+        json["lastUs"] = last.count();
+        json["maxUs"] = max.count();
+        json["avgUs"] = count == 0 ? 0 : total.count() / count;
+    }
+
+    unsigned long count = 0;
+    microseconds last = microseconds::zero();
+    microseconds max = microseconds::zero();
+    microseconds total = microseconds::zero();
+};
+
+/**
+ * @brief The device side of the MQTT protocol, independent of the MQTT library and of JSON.
+ *
+ * Queues outgoing messages, connects and subscribes to the configuration and command topics,
+ * and routes incoming messages to their handlers. <code>MqttHandler</code> runs it on the device,
+ * and tests run it against a loopback stand-in for the broker.
+ *
+ * @tparam Clock measures the time operations take, and when messages were captured.
+ * @tparam QueueCapacity the maximum number of messages waiting to be published.
+ */
+template <typename Clock, size_t QueueCapacity>
+class MqttSession {
+public:
+    struct Message {
+        std::string topic;
+        std::string payload;
+        bool retain = false;
+        int qos = 0;
+        // Zero if the message should not be timestamped
+        typename Clock::time_point capturedAt;
+        std::function<void()> onPublished;
+    };
+
+    /**
+     * @brief Performance metrics collected while running.
+     *
+     * Allows catching queueing and allocation regressions on real hardware
+     * against a real broker.
+     */
+    struct Metrics {
+        unsigned long queued = 0;
+        unsigned long dropped = 0;
+        unsigned long published = 0;
+        unsigned long failed = 0;
+        size_t queueHighWatermark = 0;
+        MqttTimingStats flush;
+        MqttTimingStats commands;
+        MqttTimingStats configUpdates;
+        unsigned long rejectedConfigUpdates = 0;
+        MqttTimingStats connects;
+        unsigned long failedConnects = 0;
+
+        template <typename Json>
+        void populate(Json& json) const {
+            json["queued"] = queued;
+            json["dropped"] = dropped;
+            json["published"] = published;
+            json["failed"] = failed;
+            json["queueHighWatermark"] = queueHighWatermark;
+            flush.populate(json.createNestedObject("flush"));
+            commands.populate(json.createNestedObject("commands"));
+            configUpdates.populate(json.createNestedObject("configUpdates"));
+            json["rejectedConfigUpdates"] = rejectedConfigUpdates;
+            connects.populate(json.createNestedObject("connects"));
+            json["failedConnects"] = failedConnects;
+        }
+    };
+
+    /**
+     * @brief Handles a command, and sets <code>response</code> to publish, or leaves it empty.
+     */
+    typedef std::function<void(const std::string& request, std::string& response)> CommandHandler;
+
+    /**
+     * @brief Applies a configuration update, returns false if it was rejected.
+     */
+    typedef std::function<bool(const std::string& payload)> ConfigHandler;
+
+    MqttSession(MqttClient& client)
+        : client(client) {
+    }
+
+    void begin(const std::string& clientId, const std::string& topic) {
+        this->clientId = clientId;
+        this->topic = topic;
+        configTopic = topic + "/config";
+        configPatchTopic = topic + "/config/patch";
+        commandTopicPrefix = topic + "/commands/";
+        client.onMessage([this](const std::string& topic, const std::string& payload) {
+            receive(topic, payload);
+        });
+    }
+
+    void onConfig(ConfigHandler handler) {
+        configHandler = handler;
+    }
+
+    void onConfigPatch(ConfigHandler handler) {
+        configPatchHandler = handler;
+    }
+
+    /**
+     * @brief Called with the topic of messages that are neither configuration nor a registered command.
+     */
+    void onUnknownMessage(std::function<void(const std::string& topic)> handler) {
+        unknownMessageHandler = handler;
+    }
+
+    /**
+     * @brief Converts the time a message was captured to milliseconds since the UNIX epoch, returns false if the wall clock is not known yet.
+     */
+    void onTimestamp(std::function<bool(typename Clock::time_point, int64_t&)> toUtcMillis) {
+        this->toUtcMillis = toUtcMillis;
+    }
+
+    void registerCommand(const std::string& command, CommandHandler handler) {
+        commandHandlers.emplace_back(command, handler);
+    }
+
+    /**
+     * @brief Queues a message to be published by the next <code>flush()</code>.
+     *
+     * @return false if the oldest queued message had to be dropped to make room.
+     */
+    bool publish(Message message) {
+        bool storedWithoutDropping = publishQueue.push(std::move(message));
+        metrics.queued++;
+        metrics.queueHighWatermark = std::max(metrics.queueHighWatermark, publishQueue.size());
+        if (!storedWithoutDropping) {
+            metrics.dropped++;
+        }
+        return storedWithoutDropping;
+    }
+
+    /**
+     * @brief Publishes every queued message; messages that fail to publish are dropped.
+     */
+    void flush() {
+        if (publishQueue.isEmpty()) {
+            return;
+        }
+        auto flushStart = Clock::now();
+        publishQueue.flush([&](const Message& message) {
+            bool success = message.capturedAt == typename Clock::time_point()
+                ? client.publish(message.topic, message.payload, message.retain, message.qos)
+                : client.publish(message.topic, withTimestamp(message), message.retain, message.qos);
+            if (success) {
+                metrics.published++;
+                if (message.onPublished) {
+                    message.onPublished();
+                }
+            } else {
+                metrics.failed++;
+            }
+            return success;
+        });
+        metrics.flush.record(duration_cast<microseconds>(Clock::now() - flushStart));
+    }
+
+    /**
+     * @brief Connects to the broker unless already connected, and subscribes to the configuration and command topics.
+     */
+    bool connect() {
+        if (client.connected()) {
+            return true;
+        }
+        auto connectStart = Clock::now();
+        if (!client.connect(clientId)) {
+            // Clean up the client
+            client.disconnect();
+            metrics.failedConnects++;
+            return false;
+        }
+        metrics.connects.record(duration_cast<microseconds>(Clock::now() - connectStart));
+
+        subscribe("config", 2);
+        subscribe("config/patch", 2);
+        subscribe("commands/#", 2);
+        return true;
+    }
+
+    bool isConnected() {
+        return client.connected();
+    }
+
+    bool subscribe(const std::string& suffix, int qos) {
+        if (!client.connected()) {
+            return false;
+        }
+        return client.subscribe(topic + "/" + suffix, qos);
+    }
+
+    /**
+     * @brief Receives incoming messages, and passes them to their handlers.
+     */
+    void loop() {
+        client.loop();
+    }
+
+    size_t queuedMessages() const {
+        return publishQueue.size();
+    }
+
+    const std::string& getTopic() const {
+        return topic;
+    }
+
+    const Metrics& getMetrics() const {
+        return metrics;
+    }
+
+    void resetMetrics() {
+        metrics = Metrics();
+    }
+
+private:
+    void receive(const std::string& topic, const std::string& payload) {
+        auto receivedAt = Clock::now();
+        if (topic == configTopic || topic == configPatchTopic) {
+            auto& handler = topic == configTopic ? configHandler : configPatchHandler;
+            if (!handler) {
+                return;
+            }
+            if (!handler(payload)) {
+                metrics.rejectedConfigUpdates++;
+                return;
+            }
+            metrics.configUpdates.record(duration_cast<microseconds>(Clock::now() - receivedAt));
+        } else if (topic.compare(0, commandTopicPrefix.length(), commandTopicPrefix) == 0) {
+            // Clearing the command topic echoes back an empty message
+            if (payload.empty()) {
+                return;
+            }
+            std::string command = topic.substr(commandTopicPrefix.length());
+            for (auto& entry : commandHandlers) {
+                if (entry.first == command) {
+                    // Clear command topic
+                    client.publish(topic, "", true, 0);
+                    std::string response;
+                    entry.second(payload, response);
+                    if (!response.empty()) {
+                        Message message;
+                        message.topic = this->topic + "/responses/" + command;
+                        message.payload = std::move(response);
+                        message.qos = 2;
+                        publish(std::move(message));
+                    }
+                    metrics.commands.record(duration_cast<microseconds>(Clock::now() - receivedAt));
+                    return;
+                }
+            }
+            if (unknownMessageHandler) {
+                unknownMessageHandler(topic);
+            }
+        } else if (unknownMessageHandler) {
+            unknownMessageHandler(topic);
+        }
+    }
+
+    /**
+     * @brief Adds the time the message was captured to its payload, if the wall clock is known by now.
+     *
+     * This happens when the message is sent rather than when it is queued,
+     * so that messages queued before the clock has been synchronized are timestamped correctly, too.
+     */
+    std::string withTimestamp(const Message& message) const {
+        int64_t utcMillis;
+        const std::string& payload = message.payload;
+        if (!toUtcMillis || !toUtcMillis(message.capturedAt, utcMillis)
+            || payload.empty() || payload.back() != '}') {
+            return payload;
+        }
+        std::string timestamped = payload.substr(0, payload.length() - 1);
+        if (timestamped != "{") {
+            timestamped += ",";
+        }
+        char timestamp[40];
+        snprintf(timestamp, sizeof(timestamp), "\"timestamp\":%lld}", (long long) utcMillis);
+        timestamped += timestamp;
+        return timestamped;
+    }
+
+    MqttClient& client;
+
+    std::string clientId;
+    std::string topic;
+    std::string configTopic;
+    std::string configPatchTopic;
+    std::string commandTopicPrefix;
+
+    ConfigHandler configHandler;
+    ConfigHandler configPatchHandler;
+    std::function<void(const std::string&)> unknownMessageHandler;
+    std::function<bool(typename Clock::time_point, int64_t&)> toUtcMillis;
+    std::list<std::pair<std::string, CommandHandler>> commandHandlers;
+
+    MqttPublishQueue<Message, QueueCapacity> publishQueue;
+
+    Metrics metrics;
+};
+
+}}    // namespace farmhub::client
@@ -4,12 +4,24 @@
 #include <esp_sntp.h>
 
 #include "MdnsHandler.hpp"
+#include "RtcRecord.hpp"
 #include "Task.hpp"
+#include "WallClock.hpp"
 
 using namespace std::chrono;
 
 namespace farmhub { namespace client {
 
+struct NtpRtcState {
+    // System time of the last successful update in seconds since the UNIX epoch
+    int64_t lastUpdated;
+};
+
+using NtpRtcRecord = RtcRecord<NtpRtcState, 16>;
+
+RTC_DATA_ATTR
+NtpRtcRecord::Slot ntpHandlerRtcSlot;
+
 void ntpUpdated(struct timeval* tv) {
     Serial.printf("NTP updated system clock to %ld\n", tv->tv_sec);
 }
@@ -25,13 +37,25 @@ public:
 
     void begin() {
         sntp_set_time_sync_notification_cb(ntpUpdated);
+
+        // The RTC keeps time across deep sleep, no need to update it after every wake
+        NtpRtcState saved;
+        if (rtcState.restore(saved)) {
+            int64_t sinceLastUpdate = time(nullptr) - saved.lastUpdated;
+            if (sinceLastUpdate >= 0 && seconds { sinceLastUpdate } < NTP_UPDATE_PERIOD) {
+                Serial.printf("Time was updated from NTP %lld seconds ago\n", (long long) sinceLastUpdate);
+                lastChecked = boot_clock::now() - seconds { sinceLastUpdate };
+                state = State::CONNECTED;
+            }
+        }
     }
 
     const Schedule loop(const Timing& timing) override {
         switch (state) {
             case State::CONNECTED:
-                // Reconnect every week
-                if (timing.loopStartTime - lastChecked > hours { 7 * 24 }) {
+                // SNTP keeps adjusting the system clock in the background
+                WallClock::synchronize();
+                if (timing.loopStartTime - lastChecked > NTP_UPDATE_PERIOD) {
                     state = State::DISCONNECTED;
                 }
                 break;
@@ -57,6 +81,8 @@ public:
                 if (sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED) {
                     long currentTime = time(nullptr);
                     Serial.printf("Current time is %ld\n", currentTime);
+                    WallClock::synchronize();
+                    rtcState.save({ currentTime });
                     lastChecked = timing.loopStartTime;
                     state = State::CONNECTED;
                     return sleepFor(hours { 1 });
@@ -77,6 +103,10 @@ public:
     }
 
 private:
+    // Reconnect every week
+    const hours NTP_UPDATE_PERIOD { 7 * 24 };
+
+    NtpRtcRecord rtcState { ntpHandlerRtcSlot, 1 };
     time_point<boot_clock> lastChecked;
     MdnsHandler& mdns;
 
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Preferences.h>
+
+#include <Configuration.hpp>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Stores binary configuration records in NVS.
+ *
+ * NVS keys are limited to 15 characters, so records are keyed by the hash of their path.
+ */
+class NvsConfigurationStore : public ConfigurationStore {
+public:
+    void begin(const String& nvsNamespace) {
+        if (!preferences.begin(nvsNamespace.c_str(), false)) {
+            fatalError("Cannot open NVS namespace " + nvsNamespace);
+        }
+    }
+
+    size_t size(const String& path) override {
+        String key = keyFor(path);
+        if (!preferences.isKey(key.c_str())) {
+            return 0;
+        }
+        return preferences.getBytesLength(key.c_str());
+    }
+
+    size_t read(const String& path, void* buffer, size_t length) override {
+        return preferences.getBytes(keyFor(path).c_str(), buffer, length);
+    }
+
+    bool write(const String& path, const void* buffer, size_t length) override {
+        return preferences.putBytes(keyFor(path).c_str(), buffer, length) == length;
+    }
+
+    void remove(const String& path) override {
+        String key = keyFor(path);
+        if (preferences.isKey(key.c_str())) {
+            preferences.remove(key.c_str());
+        }
+    }
+
+private:
+    static String keyFor(const String& path) {
+        JsonHasher hasher;
+        hasher.write(reinterpret_cast<const uint8_t*>(path.c_str()), path.length());
+        char key[16];
+        snprintf(key, sizeof(key), "%015llx", hasher.digest() & 0x0FFFFFFFFFFFFFFFULL);
+        return String(key);
+    }
+
+    Preferences preferences;
+};
+
+/**
+ * @brief Configuration stored as compact binary records in NVS.
+ *
+ * Loading the configuration does not need the file system, nor does it need to parse JSON.
+ * JSON is only used to import the configuration file on first boot, and for updates via MQTT.
+ */
+class NvsConfiguration : public Configuration {
+public:
+    /**
+     * @param name the name of the configuration, also used as the NVS namespace (max 15 characters).
+     * @param importPath the JSON file to import the configuration from if there is nothing stored in NVS yet.
+     */
+    NvsConfiguration(const String& name, const String& importPath)
+        : Configuration(name)
+        , importPath(importPath) {
+    }
+
+    void begin() {
+        auto startTime = micros();
+        store.begin(name);
+        if (BinaryConverter<uint64_t>::read(store, contentHashPath, contentHash)) {
+            loadBinary(store, "");
+            Serial.printf("Loaded %s configuration from NVS in %lu us\n",
+                name.c_str(), micros() - startTime);
+            return;
+        }
+
+        DynamicJsonDocument json(jsonCapacity());
+        ConfigurationFile importFile(importPath);
+        if (importFile.read(json)) {
+            Serial.println("Importing " + name + " configuration from " + importFile.getReadFrom());
+            update(json.as<JsonObject>());
+            Serial.printf("Loaded %s configuration from %s in %lu us\n",
+                name.c_str(), importFile.getReadFrom().c_str(), micros() - startTime);
+        } else {
+            Serial.println("The " + name + " configuration was not found in NVS, falling back to defaults");
+            load(json.as<JsonObject>());
+        }
+    }
+
+    void update(const JsonObject& json) override {
+        uint64_t hash = JsonHasher::hash(json);
+        if (hash == contentHash) {
+            Serial.println("The " + name + " configuration is unchanged, skipping update");
+            return;
+        }
+        Configuration::update(json);
+        storeBinary(store, "");
+        contentHash = hash;
+        BinaryConverter<uint64_t>::write(store, contentHashPath, contentHash);
+    }
+
+    /**
+     * @brief Patches the configuration, and stores the patched entries.
+     *
+     * NVS does not rewrite records whose value is unchanged, so only the patched entries hit the flash.
+     */
+    void patch(const JsonObject& json) override {
+        Configuration::patch(json);
+        storeBinary(store, "");
+        // Make sure the patched configuration is loaded from NVS after a restart even if nothing was stored before
+        BinaryConverter<uint64_t>::write(store, contentHashPath, contentHash);
+    }
+
+private:
+    const String importPath;
+    // Not a valid entry path, so it cannot collide with entries
+    const String contentHashPath = "$hash";
+    NvsConfigurationStore store;
+
+    // Hash of the last configuration update applied (patches do not change it), zero if nothing is stored
+    uint64_t contentHash = 0;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+
+#include <Configuration.hpp>
+#include <PowerProfile.hpp>
+#include <Task.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub { namespace client {
+
+const char* getPowerProfileName(PowerProfile profile) {
+    switch (profile) {
+        case PowerProfile::Auto:
+            return "auto";
+        case PowerProfile::Balanced:
+            return "balanced";
+        case PowerProfile::BatterySaver:
+            return "battery-saver";
+        case PowerProfile::Performance:
+        default:
+            return "performance";
+    }
+}
+
+bool convertToJson(const PowerProfile& src, JsonVariant dst) {
+    return dst.set(getPowerProfileName(src));
+}
+void convertFromJson(JsonVariantConst src, PowerProfile& dst) {
+    String profile = src.as<String>();
+    if (profile == "auto") {
+        dst = PowerProfile::Auto;
+    } else if (profile == "balanced") {
+        dst = PowerProfile::Balanced;
+    } else if (profile == "battery-saver") {
+        dst = PowerProfile::BatterySaver;
+    } else if (profile == "performance") {
+        dst = PowerProfile::Performance;
+    } else {
+        Serial.println("Unknown power profile: " + profile);
+        dst = PowerProfile::Performance;
+    }
+}
+
+/**
+ * @brief Keeps the CPU (or APB) clock at its maximum while held, even if the power profile would slow it down.
+ *
+ * Acquiring a lock that is already held does nothing, so it can be held across multiple calls, e.g. while a valve is being driven.
+ * Does nothing if power management is not available.
+ */
+class PowerLock {
+public:
+    PowerLock(const char* name, esp_pm_lock_type_t type = ESP_PM_CPU_FREQ_MAX)
+        : name(name)
+        , type(type) {
+    }
+
+    void acquire() {
+        if (held) {
+            return;
+        }
+        // Created on first use, so that unused locks take no memory
+        if (handle == nullptr && esp_pm_lock_create(type, 0, name, &handle) != ESP_OK) {
+            handle = nullptr;
+            return;
+        }
+        held = esp_pm_lock_acquire(handle) == ESP_OK;
+    }
+
+    void release() {
+        if (!held) {
+            return;
+        }
+        esp_pm_lock_release(handle);
+        held = false;
+    }
+
+private:
+    const char* name;
+    const esp_pm_lock_type_t type;
+    esp_pm_lock_handle_t handle = nullptr;
+    bool held = false;
+};
+
+/**
+ * @brief Holds a <code>PowerLock</code> while in scope.
+ */
+class PowerLockGuard {
+public:
+    PowerLockGuard(PowerLock& lock)
+        : lock(lock) {
+        lock.acquire();
+    }
+
+    ~PowerLockGuard() {
+        lock.release();
+    }
+
+private:
+    PowerLock& lock;
+};
+
+/**
+ * @brief Applies the configured power profile, and switches profiles automatically based on the battery level.
+ *
+ * A profile sets the CPU frequency bounds for dynamic frequency scaling, the WiFi power save mode,
+ * and how much telemetry and polling intervals are stretched; see <code>PowerSettings</code>.
+ */
+class PowerManager
+    : public BaseTask {
+public:
+    class Config
+        : public NamedConfigurationSection {
+    public:
+        Config(ConfigurationSection* parent)
+            : NamedConfigurationSection(parent, "power") {
+        }
+
+        Property<PowerProfile> profile { this, "profile", PowerProfile::Performance };
+        // With the "auto" profile, save the battery below this level, zero to disable
+        Property<double> lowBattery { this, "lowBattery", 0.0 };
+        // With the "auto" profile, run at full speed above this level, zero to disable
+        Property<double> highBattery { this, "highBattery", 0.0 };
+        Property<double> batteryHysteresis { this, "batteryHysteresis", 50.0 };
+    };
+
+    PowerManager(TaskContainer& tasks, const Config& config)
+        : BaseTask(tasks, "Power manager")
+        , config(config) {
+    }
+
+    void begin() {
+        update();
+    }
+
+    /**
+     * @brief Reads the battery level for the "auto" profile; without it, "auto" runs at full speed.
+     */
+    void monitorBattery(std::function<double()> batteryLevel) {
+        this->batteryLevel = batteryLevel;
+    }
+
+    /**
+     * @brief Switches to the profile that should be active now, if it is not active already.
+     */
+    void update() {
+        PowerProfile profile = config.profile.get();
+        if (profile == PowerProfile::Auto) {
+            profile = batteryLevel
+                ? PowerProfileSelector(config.lowBattery.get(), config.highBattery.get(), config.batteryHysteresis.get())
+                      .select(active, batteryLevel())
+                : PowerProfile::Performance;
+        }
+        if (profile != active) {
+            apply(profile);
+        }
+    }
+
+    PowerProfile getActiveProfile() const {
+        return active;
+    }
+
+    microseconds scale(microseconds interval) const {
+        return interval * PowerSettings::forProfile(active).intervalScale;
+    }
+
+    /**
+     * @brief Returns the interval in the property scaled by the active profile.
+     */
+    template <typename Duration>
+    std::function<microseconds()> scaled(const Property<Duration>& interval) const {
+        return [this, &interval]() {
+            return scale(duration_cast<microseconds>(interval.get()));
+        };
+    }
+
+protected:
+    const Schedule loop(const Timing& timing) override {
+        update();
+        return sleepFor(CHECK_INTERVAL);
+    }
+
+private:
+    void apply(PowerProfile profile) {
+        auto settings = PowerSettings::forProfile(profile);
+        Serial.printf("Switching to power profile '%s', CPU at %d-%d MHz\n",
+            getPowerProfileName(profile), settings.minCpuFreqMhz, settings.maxCpuFreqMhz);
+
+#if CONFIG_IDF_TARGET_ESP32S2
+        esp_pm_config_esp32s2_t pmConfig = {};
+#elif CONFIG_IDF_TARGET_ESP32S3
+        esp_pm_config_esp32s3_t pmConfig = {};
+#else
+        esp_pm_config_esp32_t pmConfig = {};
+#endif
+        pmConfig.max_freq_mhz = settings.maxCpuFreqMhz;
+        pmConfig.min_freq_mhz = settings.minCpuFreqMhz;
+        // Automatic light sleep needs tickless idle, which the Arduino core does not enable
+        pmConfig.light_sleep_enable = false;
+        esp_err_t err = esp_pm_configure(&pmConfig);
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            // Built without power management, the best we can do is to lower the clock
+            setCpuFrequencyMhz(settings.maxCpuFreqMhz);
+        } else if (err != ESP_OK) {
+            Serial.printf("Could not configure power management: %s\n", esp_err_to_name(err));
+        }
+
+        WiFi.setSleep(settings.wifiPowerSave == WiFiPowerSave::MaxModem
+                ? WIFI_PS_MAX_MODEM
+                : WIFI_PS_MIN_MODEM);
+        active = profile;
+    }
+
+    const minutes CHECK_INTERVAL { 1 };
+
+    const Config& config;
+    std::function<double()> batteryLevel;
+    // Nothing has been applied yet, see begin()
+    PowerProfile active = PowerProfile::Auto;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+
+using namespace std::chrono;
+
+namespace farmhub { namespace client {
+
+enum class PowerProfile {
+    /**
+     * @brief Pick one of the other profiles based on the battery level.
+     */
+    Auto,
+    Performance,
+    Balanced,
+    BatterySaver
+};
+
+enum class WiFiPowerSave {
+    MinModem,
+    MaxModem
+};
+
+/**
+ * @brief What a power profile means for the hardware and the application.
+ */
+struct PowerSettings {
+    int maxCpuFreqMhz;
+    // The CPU slows down to this when idle, unless a power lock is held
+    int minCpuFreqMhz;
+    WiFiPowerSave wifiPowerSave;
+    // Telemetry and polling intervals are multiplied by this
+    int intervalScale;
+
+    static PowerSettings forProfile(PowerProfile profile) {
+        switch (profile) {
+            case PowerProfile::BatterySaver:
+                return { 80, 40, WiFiPowerSave::MaxModem, 4 };
+            case PowerProfile::Balanced:
+                return { 160, 40, WiFiPowerSave::MinModem, 1 };
+            case PowerProfile::Performance:
+            default:
+                // The same as without power management
+                return { 240, 240, WiFiPowerSave::MinModem, 1 };
+        }
+    }
+};
+
+/**
+ * @brief Picks a power profile based on the battery level.
+ *
+ * Below <code>lowBattery</code> the battery is saved, above <code>highBattery</code> the device
+ * is assumed to be charging or on external power, and runs at full speed. A level between the two
+ * is balanced. The profile only changes back once the level has moved <code>hysteresis</code> past
+ * the threshold, so that a noisy reading does not flip profiles back and forth.
+ *
+ * Levels are in the same unit as the battery reading; a threshold of zero disables that side.
+ */
+class PowerProfileSelector {
+public:
+    PowerProfileSelector(double lowBattery, double highBattery, double hysteresis)
+        : lowBattery(lowBattery)
+        , highBattery(highBattery)
+        , hysteresis(hysteresis) {
+    }
+
+    PowerProfile select(PowerProfile current, double level) const {
+        if (lowBattery > 0) {
+            double threshold = current == PowerProfile::BatterySaver
+                ? lowBattery + hysteresis
+                : lowBattery;
+            if (level < threshold) {
+                return PowerProfile::BatterySaver;
+            }
+        }
+        if (highBattery > 0) {
+            double threshold = current == PowerProfile::Performance
+                ? highBattery - hysteresis
+                : highBattery;
+            if (level > threshold) {
+                return PowerProfile::Performance;
+            }
+        }
+        return PowerProfile::Balanced;
+    }
+
+private:
+    const double lowBattery;
+    const double highBattery;
+    const double hysteresis;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <RtcRecord.hpp>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Buffers messages in RTC memory, so that they survive deep sleep.
+ *
+ * Used to collect telemetry over multiple wakes without starting the radio, and to upload it in one go later.
+ * The slot holding the messages must be declared with <code>RTC_DATA_ATTR</code>:
+ *
+ * <pre>
+ * RTC_DATA_ATTR RtcMessageBuffer<2048>::Slot telemetryBatchSlot;
+ * RtcMessageBuffer<2048> telemetryBatch { telemetryBatchSlot, 1 };
+ * </pre>
+ *
+ * Like with <code>RtcRecord</code>, the contents are versioned and checksummed, and are discarded when invalid.
+ *
+ * @tparam Capacity the number of bytes available for messages, including a two-byte length for each.
+ */
+template <size_t Capacity>
+class RtcMessageBuffer {
+public:
+    static_assert(Capacity <= UINT16_MAX, "RTC message buffer is too large");
+
+    struct Slot {
+        uint16_t version;
+        uint16_t used;
+        uint16_t count;
+        uint32_t crc;
+        uint8_t data[Capacity];
+    };
+
+    /**
+     * @param version the version of the format of the messages, must not be zero.
+     */
+    RtcMessageBuffer(Slot& slot, uint16_t version)
+        : slot(slot)
+        , version(version) {
+    }
+
+    /**
+     * @brief Discards the contents unless they are valid; call after waking up.
+     *
+     * @return true if there were valid contents.
+     */
+    bool begin() {
+        if (slot.version == version && slot.used <= Capacity && slot.crc == checksum()) {
+            return true;
+        }
+        clear();
+        return false;
+    }
+
+    /**
+     * @brief Appends a message, returns false if it does not fit.
+     */
+    bool append(const uint8_t* message, size_t length) {
+        if (slot.used + sizeof(uint16_t) + length > Capacity) {
+            return false;
+        }
+        uint16_t storedLength = length;
+        memcpy(slot.data + slot.used, &storedLength, sizeof(storedLength));
+        memcpy(slot.data + slot.used + sizeof(storedLength), message, length);
+        slot.used += sizeof(storedLength) + length;
+        slot.count++;
+        slot.crc = checksum();
+        return true;
+    }
+
+    /**
+     * @brief Calls <code>consumer(const uint8_t* message, size_t length)</code> for each message in the order they were appended.
+     */
+    template <typename Consumer>
+    void forEach(Consumer consumer) const {
+        size_t offset = 0;
+        for (uint16_t i = 0; i < slot.count; i++) {
+            uint16_t length;
+            memcpy(&length, slot.data + offset, sizeof(length));
+            offset += sizeof(length);
+            consumer(slot.data + offset, length);
+            offset += length;
+        }
+    }
+
+    void clear() {
+        slot.version = version;
+        slot.used = 0;
+        slot.count = 0;
+        slot.crc = checksum();
+    }
+
+    size_t getCount() const {
+        return slot.count;
+    }
+
+    size_t getUsed() const {
+        return slot.used;
+    }
+
+    static constexpr size_t getCapacity() {
+        return Capacity;
+    }
+
+private:
+    uint32_t checksum() const {
+        uint32_t crc = 0;
+        crc = RtcChecksum::update(crc, reinterpret_cast<const uint8_t*>(&slot.version), sizeof(slot.version));
+        crc = RtcChecksum::update(crc, reinterpret_cast<const uint8_t*>(&slot.used), sizeof(slot.used));
+        crc = RtcChecksum::update(crc, reinterpret_cast<const uint8_t*>(&slot.count), sizeof(slot.count));
+        crc = RtcChecksum::update(crc, slot.data, slot.used);
+        return crc;
+    }
+
+    Slot& slot;
+    const uint16_t version;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief CRC32 of data kept in RTC memory.
+ *
+ * RTC records are small, so a bitwise implementation is fast enough, and it needs no lookup table.
+ */
+class RtcChecksum {
+public:
+    static uint32_t update(uint32_t crc, const uint8_t* data, size_t length) {
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+            }
+        }
+        return ~crc;
+    }
+};
+
+/**
+ * @brief Keeps the state of a component in RTC memory, so that it survives deep sleep.
+ *
+ * The slot holding the record must be declared with <code>RTC_DATA_ATTR</code>:
+ *
+ * <pre>
+ * RTC_DATA_ATTR RtcRecord<MeterState, 32>::Slot meterRtcSlot;
+ * RtcRecord<MeterState, 32> rtcState { meterRtcSlot, 1 };
+ * </pre>
+ *
+ * RTC memory is zeroed on power-up, and might contain the state of a previous firmware after an update.
+ * Records are therefore versioned and checksummed, and <code>restore()</code> only succeeds if the record
+ * was saved with the same version and layout, and hasn't been corrupted since.
+ *
+ * RTC slow memory is only 8 kB, so each component declares its byte budget, which is checked at compile time.
+ *
+ * @tparam T the state to keep; must be trivially copyable.
+ * @tparam Budget the maximum number of bytes the record is allowed to take up in RTC memory.
+ */
+template <typename T, size_t Budget>
+class RtcRecord {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "RTC records must be trivially copyable");
+
+    struct Slot {
+        uint16_t version;
+        uint16_t size;
+        uint32_t crc;
+        uint8_t data[sizeof(T)];
+    };
+
+    static_assert(sizeof(Slot) <= Budget, "RTC record is over its budget");
+
+    /**
+     * @param version the version of the layout of <code>T</code>, must not be zero; bump it when changing the layout.
+     */
+    RtcRecord(Slot& slot, uint16_t version)
+        : slot(slot)
+        , version(version) {
+    }
+
+    /**
+     * @brief Loads the saved state into <code>value</code>, returns false if there is no valid saved state.
+     */
+    bool restore(T& value) const {
+        if (slot.version != version || slot.size != sizeof(T) || slot.crc != checksum()) {
+            return false;
+        }
+        memcpy(&value, slot.data, sizeof(T));
+        return true;
+    }
+
+    void save(const T& value) {
+        slot.version = version;
+        slot.size = sizeof(T);
+        memcpy(slot.data, &value, sizeof(T));
+        slot.crc = checksum();
+    }
+
+    void clear() {
+        memset(&slot, 0, sizeof(Slot));
+    }
+
+private:
+    uint32_t checksum() const {
+        uint32_t crc = 0;
+        crc = RtcChecksum::update(crc, reinterpret_cast<const uint8_t*>(&slot.version), sizeof(slot.version));
+        crc = RtcChecksum::update(crc, reinterpret_cast<const uint8_t*>(&slot.size), sizeof(slot.size));
+        crc = RtcChecksum::update(crc, slot.data, sizeof(slot.data));
+        return crc;
+    }
+
+    Slot& slot;
+    const uint16_t version;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Aggregates the samples of a value taken during a telemetry window.
+ *
+ * Only running aggregates are kept, so memory use is fixed regardless of how many samples are taken.
+ */
+class SampleWindow {
+public:
+    void record(double value) {
+        if (count == 0) {
+            min = value;
+            max = value;
+        } else {
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        sum += value;
+        last = value;
+        count++;
+    }
+
+    /**
+     * @brief Starts a new window.
+     */
+    void reset() {
+        count = 0;
+        sum = 0;
+    }
+
+    size_t getCount() const {
+        return count;
+    }
+
+    double getMin() const {
+        return min;
+    }
+
+    double getMax() const {
+        return max;
+    }
+
+    double getMean() const {
+        return count == 0 ? 0 : sum / count;
+    }
+
+    double getLast() const {
+        return last;
+    }
+
+    /**
+     * @brief Adds <code>min</code>, <code>max</code>, <code>mean</code>, <code>last</code> and <code>count</code> to the given object.
+     */
+    void populate(JsonObject json) const {
+        json["min"] = getMin();
+        json["max"] = getMax();
+        json["mean"] = getMean();
+        json["last"] = getLast();
+        json["count"] = getCount();
+    }
+
+private:
+    size_t count = 0;
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+    double last = 0;
+};
+
+}}    // namespace farmhub::client
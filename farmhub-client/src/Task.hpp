@@ -224,6 +224,15 @@ public:
         , callback(callback) {
     }
 
+    /**
+     * @brief Creates a task whose delay is calculated anew after each execution.
+     */
+    IntervalTask(TaskContainer& tasks, const String& name, std::function<microseconds()> delay, std::function<void()> callback)
+        : BaseTask(tasks, name)
+        , delay(delay)
+        , callback(callback) {
+    }
+
     template <typename Duration = milliseconds>
     IntervalTask(TaskContainer& tasks, const String& name, const Property<Duration>& delay, std::function<void()> callback)
         : BaseTask(tasks, name)
@@ -233,13 +242,26 @@ public:
         , callback(callback) {
     }
 
+    /**
+     * @brief Returns how long until the task is due to run again, zero if it has not run yet.
+     */
+    microseconds timeUntilNextRun() const {
+        if (lastRun == time_point<boot_clock>()) {
+            return microseconds::zero();
+        }
+        microseconds remaining = lastRun + delay() - boot_clock::now();
+        return std::max(remaining, microseconds::zero());
+    }
+
 protected:
     const Schedule loop(const Timing& timing) override {
         callback();
+        lastRun = timing.scheduledTime;
         return sleepFor(delay());
     }
 
 private:
+    time_point<boot_clock> lastRun;
     const std::function<microseconds()> delay;
     const std::function<void()> callback;
 };
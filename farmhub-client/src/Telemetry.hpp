@@ -5,6 +5,13 @@
 #include <list>
 
 #include <MqttHandler.hpp>
+#include <SampleWindow.hpp>
+#include <Task.hpp>
+#include <TelemetryFilter.hpp>
+#include <TimeSeriesStore.hpp>
+
+// Do not store samples before the clock is set (2020-01-01T00:00:00Z)
+#define TELEMETRY_VALID_TIME_MIN 1577836800
 
 namespace farmhub { namespace client {
 
@@ -14,6 +21,134 @@ protected:
     friend class TelemetryPublisher;
 };
 
+/**
+ * @brief A telemetry provider that samples its values on its own schedule.
+ *
+ * Each field is reported as the <code>min</code>, <code>max</code>, <code>mean</code>, <code>last</code> value
+ * and the <code>count</code> of the samples taken since the previous publish. This way short events are
+ * not missed, even when telemetry is published rarely.
+ */
+class SampledTelemetryProvider
+    : public BaseTask,
+      public TelemetryProvider {
+public:
+    class Field {
+    public:
+        Field(SampledTelemetryProvider* provider, const String& name)
+            : name(name) {
+            provider->fields.push_back(this);
+        }
+
+        void record(double value) {
+            window.record(value);
+        }
+
+    private:
+        const String name;
+        SampleWindow window;
+
+        friend class SampledTelemetryProvider;
+    };
+
+    /**
+     * @brief Takes a sample right away, blocking while the measurement is prepared.
+     *
+     * For when telemetry is needed before the task gets to run, e.g. during a short wake from deep sleep.
+     */
+    void sampleNow() {
+        auto preparation = prepareSample();
+        if (preparation > microseconds::zero()) {
+            delay(duration_cast<milliseconds>(preparation).count());
+        }
+        sample();
+    }
+
+protected:
+    SampledTelemetryProvider(TaskContainer& tasks, const String& name, microseconds interval)
+        : BaseTask(tasks, name)
+        , interval([interval]() {
+            return interval;
+        }) {
+    }
+
+    template <typename Duration>
+    SampledTelemetryProvider(TaskContainer& tasks, const String& name, const Property<Duration>& interval)
+        : BaseTask(tasks, name)
+        , interval([&interval]() {
+            return duration_cast<microseconds>(interval.get());
+        }) {
+    }
+
+    /**
+     * @brief Creates a provider whose sampling interval is calculated anew after each sample.
+     */
+    SampledTelemetryProvider(TaskContainer& tasks, const String& name, std::function<microseconds()> interval)
+        : BaseTask(tasks, name)
+        , interval(interval) {
+    }
+
+    /**
+     * @brief Starts taking a measurement, and returns how long it takes.
+     *
+     * Sensors that take a long time to measure can start measuring here without blocking,
+     * and collect the results in <code>sample()</code>, which is called after the returned delay.
+     */
+    virtual microseconds prepareSample() {
+        return microseconds::zero();
+    }
+
+    /**
+     * @brief Samples the fields via <code>Field::record()</code>.
+     */
+    virtual void sample() = 0;
+
+    const Schedule loop(const Timing& timing) override {
+        if (!preparing) {
+            preparationTime = prepareSample();
+            if (preparationTime > microseconds::zero()) {
+                preparing = true;
+                return sleepFor(preparationTime);
+            }
+        }
+        preparing = false;
+        sample();
+        return sleepFor(std::max(interval() - preparationTime, microseconds::zero()));
+    }
+
+    void populateTelemetry(JsonObject& json) override {
+        bool empty = true;
+        for (auto field : fields) {
+            if (field->window.getCount() > 0) {
+                empty = false;
+                break;
+            }
+        }
+        if (empty) {
+            // Telemetry is published before the first sample is taken after startup
+            sample();
+        }
+
+        for (auto field : fields) {
+            if (field->window.getCount() > 0) {
+                field->window.populate(json.createNestedObject(field->name));
+                field->window.reset();
+            }
+        }
+    }
+
+private:
+    const std::function<microseconds()> interval;
+    std::list<Field*> fields;
+    bool preparing = false;
+    microseconds preparationTime = microseconds::zero();
+};
+
+/**
+ * @brief Publishes the telemetry of the registered providers to a topic at regular intervals.
+ *
+ * Applications can create multiple publishers as separate channels, e.g. to publish fast-changing
+ * data more often than the rest. Each provider should be registered with a single channel only.
+ */
 class TelemetryPublisher
     : public IntervalTask {
 public:
@@ -23,7 +158,7 @@ public:
         milliseconds interval,
         const String& topic = "telemetry",
         const MqttHandler::QoS qos = MqttHandler::QoS::AtLeastOnce)
-        : IntervalTask(tasks, "Publish telemetry", interval, [&]() { publish(); })
+        : IntervalTask(tasks, "Publish " + topic, interval, [&]() { publishChanges(); })
         , mqtt(mqtt)
         , topic(topic)
         , qos(qos) {
@@ -36,32 +171,247 @@ public:
         Property<Duration>& interval,
         const String& topic = "telemetry",
         const MqttHandler::QoS qos = MqttHandler::QoS::AtLeastOnce)
-        : IntervalTask(tasks, "Publish telemetry", interval, [&]() { publish(); })
+        : IntervalTask(tasks, "Publish " + topic, interval, [&]() { publishChanges(); })
+        , mqtt(mqtt)
+        , topic(topic)
+        , qos(qos) {
+    }
+
+    /**
+     * @brief Creates a publisher whose interval is calculated anew after each publish.
+     */
+    TelemetryPublisher(
+        TaskContainer& tasks,
+        MqttHandler& mqtt,
+        std::function<microseconds()> interval,
+        const String& topic,
+        const MqttHandler::QoS qos = MqttHandler::QoS::AtLeastOnce)
+        : IntervalTask(tasks, "Publish " + topic, interval, [&]() { publishChanges(); })
         , mqtt(mqtt)
         , topic(topic)
         , qos(qos) {
     }
 
-    void registerProvider(TelemetryProvider& provider) {
-        providers.push_back(std::reference_wrapper<TelemetryProvider>(provider));
+    /**
+     * @brief Registers a provider whose telemetry is to be published.
+     *
+     * @param name identifies the provider in the metrics.
+     * @param budget the time the provider may take to populate its telemetry; zero means no limit.
+     *   A provider that goes over budget is not called when publishing next time; its previous telemetry
+     *   is published instead, and it gets refreshed after the telemetry has been sent.
+     *   Do not set a budget for providers that reset their values when populating telemetry.
+     */
+    void registerProvider(TelemetryProvider& provider, const String& name = "", microseconds budget = microseconds::zero()) {
+        providers.emplace_back(provider,
+            name.isEmpty() ? "provider" + String(providers.size()) : name,
+            budget);
     }
 
+    /**
+     * @brief Records all published telemetry in the given store, including fields that are not published because they have not changed.
+     */
+    void recordTo(TimeSeriesStore& store) {
+        this->store = &store;
+    }
+
+    /**
+     * @brief Collects the telemetry of all providers without publishing or recording it.
+     */
+    void collect(JsonObject& json) {
+        populate(json);
+    }
+
+    const String& getTopic() const {
+        return topic;
+    }
+
+    /**
+     * @brief Adds the time each provider takes to populate its telemetry.
+     */
+    void populateMetrics(JsonObject& json) const {
+        for (auto& entry : providers) {
+            JsonObject metrics = json.createNestedObject(entry.name);
+            entry.timing.populate(metrics);
+            if (entry.budget > microseconds::zero()) {
+                metrics["budgetUs"] = entry.budget.count();
+                metrics["overBudget"] = entry.overBudgetCount;
+                metrics["servedFromCache"] = entry.servedFromCacheCount;
+            }
+        }
+    }
+
+    /**
+     * @brief Only report the field when it moves more than the given amount since it was last reported.
+     *
+     * Has no effect unless a maximum silence interval is set via <code>setMaxSilence()</code>.
+     */
+    void setDeadband(const String& field, double deadband) {
+        filter.setDeadband(field.c_str(), deadband);
+    }
+
+    /**
+     * @brief Report the field whenever it is not zero; for values that are reset after each report.
+     */
+    void setAccumulated(const String& field) {
+        filter.setAccumulated(field.c_str());
+    }
+
+    /**
+     * @brief Publish only changed fields at each interval, and all fields once the given interval has passed.
+     *
+     * Setting the interval to zero (the default) publishes all fields at every interval.
+     */
+    template <typename Duration>
+    void setMaxSilence(const Property<Duration>& maxSilence) {
+        this->maxSilence = [&maxSilence]() {
+            return duration_cast<milliseconds>(maxSilence.get());
+        };
+    }
+
+    /**
+     * @brief Publishes all fields.
+     */
     void publish() {
         DynamicJsonDocument doc(2048);
         JsonObject root = doc.to<JsonObject>();
-        root["uptime"] = millis();
-        for (auto& provider : providers) {
-            provider.get().populateTelemetry(root);
+        populate(root);
+        record(root);
+        filter.reportedAll(root, currentTime());
+        publish(doc);
+    }
+
+    /**
+     * @brief Publishes the fields that have changed, or everything if the maximum silence interval has passed.
+     */
+    void publishChanges() {
+        DynamicJsonDocument doc(2048);
+        JsonObject root = doc.to<JsonObject>();
+        populate(root);
+        record(root);
+        filter.setMaxSilence(maxSilence());
+        if (!filter.filter(root, currentTime())) {
+            Serial.println("Telemetry unchanged, skipping publish");
+            return;
         }
-        mqtt.publish(topic, doc, MqttHandler::Retention::NoRetain, qos);
+        publish(doc);
+    }
+
+protected:
+    const Schedule loop(const Timing& timing) override {
+        if (refreshRound) {
+            // Refresh slow providers now that the telemetry has been sent
+            refreshRound = false;
+            for (auto& entry : providers) {
+                if (entry.overBudget) {
+                    populateProvider(entry);
+                }
+            }
+            return sleepFor(nextPublishAt - timing.scheduledTime);
+        }
+        auto schedule = IntervalTask::loop(timing);
+        if (refreshPending) {
+            refreshPending = false;
+            refreshRound = true;
+            nextPublishAt = timing.scheduledTime + schedule.delay;
+            // Let the MQTT handler send the telemetry first
+            return yieldImmediately();
+        }
+        return schedule;
     }
 
 private:
+    struct ProviderEntry {
+        ProviderEntry(TelemetryProvider& provider, const String& name, microseconds budget)
+            : provider(provider)
+            , name(name)
+            , budget(budget) {
+            if (budget > microseconds::zero()) {
+                cache.reset(new DynamicJsonDocument(512));
+            }
+        }
+
+        TelemetryProvider& provider;
+        const String name;
+        const microseconds budget;
+        // The last telemetry of providers with a budget
+        std::unique_ptr<DynamicJsonDocument> cache;
+        bool overBudget = false;
+        MqttHandler::TimingStats timing;
+        unsigned long overBudgetCount = 0;
+        unsigned long servedFromCacheCount = 0;
+    };
+
+    void populate(JsonObject& root) {
+        for (auto& entry : providers) {
+            if (entry.overBudget) {
+                entry.servedFromCacheCount++;
+                refreshPending = true;
+            } else if (entry.budget == microseconds::zero()) {
+                auto start = boot_clock::now();
+                entry.provider.populateTelemetry(root);
+                entry.timing.record(duration_cast<microseconds>(boot_clock::now() - start));
+                continue;
+            } else {
+                populateProvider(entry);
+            }
+            for (JsonPair field : entry.cache->as<JsonObject>()) {
+                root[field.key()] = field.value();
+            }
+        }
+    }
+
+    void record(const JsonObject& root) {
+        if (store == nullptr) {
+            return;
+        }
+        time_t now = time(nullptr);
+        if (now < TELEMETRY_VALID_TIME_MIN) {
+            return;
+        }
+        store->record(root, now);
+    }
+
+    /**
+     * @brief Populates the cached telemetry of a provider with a budget.
+     */
+    void populateProvider(ProviderEntry& entry) {
+        auto start = boot_clock::now();
+        JsonObject json = entry.cache->to<JsonObject>();
+        entry.provider.populateTelemetry(json);
+        auto elapsed = duration_cast<microseconds>(boot_clock::now() - start);
+        entry.timing.record(elapsed);
+        entry.overBudget = elapsed > entry.budget;
+        if (entry.overBudget) {
+            entry.overBudgetCount++;
+            Serial.printf("Telemetry provider '%s' took %ld us, over its budget of %ld us\n",
+                entry.name.c_str(), (long) elapsed.count(), (long) entry.budget.count());
+        }
+    }
+
+    void publish(DynamicJsonDocument& doc) {
+        // Uptime always changes, so it is not subject to filtering
+        doc["uptime"] = millis();
+        mqtt.publish(topic, doc, MqttHandler::Retention::NoRetain, qos, MqttHandler::Timestamp::Include);
+    }
+
+    static milliseconds currentTime() {
+        return duration_cast<milliseconds>(boot_clock::now().time_since_epoch());
+    }
+
+    TelemetryFilter filter;
+    TimeSeriesStore* store = nullptr;
+    std::function<milliseconds()> maxSilence = []() {
+        return milliseconds::zero();
+    };
+
     MqttHandler& mqtt;
     const String topic;
     const MqttHandler::QoS qos;
 
-    std::list<std::reference_wrapper<TelemetryProvider>> providers;
+    std::list<ProviderEntry> providers;
+    bool refreshPending = false;
+    bool refreshRound = false;
+    time_point<boot_clock> nextPublishAt;
 };
 
 }}    // namespace farmhub::client
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Drops telemetry fields that have not changed significantly since they were last reported.
+ *
+ * A numeric field is reported when it moves more than its deadband (zero by default) away from the value
+ * last reported. Sampled fields are compared by their <code>mean</code>, and any other value is reported
+ * when it changes at all. Accumulated fields that start from zero after each report (like volume)
+ * are reported whenever they are not zero.
+ *
+ * Every field is reported once the maximum silence interval has elapsed since the last full report,
+ * so that the receiving end can tell a stable value from a device that went silent.
+ * A maximum silence interval of zero disables filtering.
+ */
+class TelemetryFilter {
+public:
+    void setDeadband(const std::string& field, double deadband) {
+        deadbands[field] = deadband;
+    }
+
+    void setAccumulated(const std::string& field) {
+        accumulated.insert(field);
+    }
+
+    void setMaxSilence(std::chrono::milliseconds maxSilence) {
+        this->maxSilence = maxSilence;
+    }
+
+    /**
+     * @brief Removes the fields that do not need to be reported.
+     *
+     * @param now the current time, measured from any fixed point.
+     * @return whether there is anything left to report.
+     */
+    bool filter(JsonObject telemetry, std::chrono::milliseconds now) {
+        if (maxSilence <= std::chrono::milliseconds::zero()
+            || !refreshed
+            || now - lastRefresh >= maxSilence) {
+            reportedAll(telemetry, now);
+            return true;
+        }
+
+        std::vector<std::string> unchanged;
+        for (JsonPair field : telemetry) {
+            std::string name = field.key().c_str();
+            Value current = Value::of(field.value());
+            bool changed;
+            if (accumulated.count(name) > 0) {
+                changed = !current.isZero();
+            } else {
+                auto previous = values.find(name);
+                changed = previous == values.end() || current.differsFrom(previous->second, deadbandOf(name));
+            }
+            if (!changed) {
+                unchanged.push_back(name);
+            } else {
+                values[name] = current;
+            }
+        }
+        for (auto& name : unchanged) {
+            telemetry.remove(name.c_str());
+        }
+        return telemetry.size() > 0;
+    }
+
+    /**
+     * @brief Records all the fields as reported, and restarts the maximum silence interval.
+     */
+    void reportedAll(JsonObjectConst telemetry, std::chrono::milliseconds now) {
+        values.clear();
+        for (JsonPairConst field : telemetry) {
+            values[field.key().c_str()] = Value::of(field.value());
+        }
+        lastRefresh = now;
+        refreshed = true;
+    }
+
+private:
+    struct Value {
+        static Value of(JsonVariantConst json) {
+            Value value;
+            JsonVariantConst number = json.is<JsonObjectConst>()
+                ? json["mean"]
+                : json;
+            if (number.is<double>()) {
+                value.numeric = true;
+                value.number = number.as<double>();
+            } else {
+                serializeJson(json, value.serialized);
+            }
+            return value;
+        }
+
+        bool differsFrom(const Value& other, double deadband) const {
+            if (numeric && other.numeric) {
+                return std::fabs(number - other.number) > deadband;
+            }
+            return numeric != other.numeric || serialized != other.serialized;
+        }
+
+        bool isZero() const {
+            return numeric && number == 0;
+        }
+
+        bool numeric = false;
+        double number = 0;
+        std::string serialized;
+    };
+
+    double deadbandOf(const std::string& field) const {
+        auto deadband = deadbands.find(field);
+        return deadband == deadbands.end() ? 0 : deadband->second;
+    }
+
+    std::map<std::string, double> deadbands;
+    std::set<std::string> accumulated;
+    std::chrono::milliseconds maxSilence = std::chrono::milliseconds::zero();
+    std::map<std::string, Value> values;
+    std::chrono::milliseconds lastRefresh = std::chrono::milliseconds::zero();
+    bool refreshed = false;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief A single sample of a time series; time is in seconds since the UNIX epoch.
+ */
+struct RawSample {
+    uint32_t time;
+    float value;
+};
+
+/**
+ * @brief Aggregate of the samples of a time series in a period starting at <code>time</code>.
+ */
+struct RollupSample {
+    uint32_t time;
+    float min;
+    float max;
+    float mean;
+    uint32_t count;
+};
+
+/**
+ * @brief Aggregates samples into fixed periods aligned to the UNIX epoch.
+ */
+class Downsampler {
+public:
+    Downsampler(uint32_t period)
+        : period(period) {
+    }
+
+    /**
+     * @brief Adds a sample, and returns true if it closed the previous period, which is then stored in <code>completed</code>.
+     */
+    bool add(uint32_t time, float value, RollupSample& completed) {
+        uint32_t start = time - time % period;
+        bool closed = false;
+        if (current.count > 0 && start != current.time) {
+            completed = current;
+            completed.mean = sum / current.count;
+            current.count = 0;
+            closed = true;
+        }
+        if (current.count == 0) {
+            current.time = start;
+            current.min = value;
+            current.max = value;
+            sum = 0;
+        } else {
+            current.min = std::min(current.min, value);
+            current.max = std::max(current.max, value);
+        }
+        sum += value;
+        current.count++;
+        return closed;
+    }
+
+    /**
+     * @brief Restores the open period from the newest raw samples, e.g. after a restart or deep sleep.
+     *
+     * Only closed periods are stored, so the open one would be lost otherwise.
+     */
+    template <typename Ring>
+    void resume(Ring& raw) {
+        current.count = 0;
+        if (raw.size() == 0) {
+            return;
+        }
+        uint32_t newest = raw.newestTime();
+        RollupSample completed;
+        // All samples fall in the same period, so none is closed
+        raw.queryTail(newest - newest % period, [&](const RawSample& sample) {
+            add(sample.time, sample.value, completed);
+        });
+    }
+
+    const uint32_t period;
+
+private:
+    RollupSample current { 0, 0, 0, 0, 0 };
+    double sum = 0;
+};
+
+/**
+ * @brief Storage of fixed-size records and a header, e.g. a file.
+ */
+class RingStorage {
+public:
+    virtual bool read(size_t offset, void* buffer, size_t length) = 0;
+    virtual bool write(size_t offset, const void* buffer, size_t length) = 0;
+};
+
+/**
+ * @brief A round-robin buffer of records persisted in a storage; once full, the oldest records are overwritten.
+ *
+ * Records must start with a <code>uint32_t time</code> field.
+ */
+template <typename Record>
+class RecordRing {
+public:
+    RecordRing(RingStorage& storage, uint32_t capacity)
+        : storage(storage)
+        , capacity(capacity) {
+    }
+
+    /**
+     * @brief Reads the state of the ring from the storage, and starts a new ring if it is missing or has a different layout.
+     */
+    void begin() {
+        if (!storage.read(0, &header, sizeof(header))
+            || header.magic != RING_MAGIC
+            || header.recordSize != sizeof(Record)
+            || header.capacity != capacity
+            || header.head >= capacity
+            || header.count > capacity) {
+            header = { RING_MAGIC, sizeof(Record), capacity, 0, 0 };
+            storage.write(0, &header, sizeof(header));
+        }
+    }
+
+    void append(const Record& record) {
+        storage.write(offsetOf(header.head), &record, sizeof(Record));
+        header.head = (header.head + 1) % capacity;
+        header.count = std::min(header.count + 1, capacity);
+        storage.write(0, &header, sizeof(header));
+    }
+
+    size_t size() const {
+        return header.count;
+    }
+
+    /**
+     * @brief Passes the records with <code>from <= time < to</code> to the consumer, oldest first, until it returns false.
+     */
+    void query(uint32_t from, uint32_t to, std::function<bool(const Record&)> consumer) {
+        uint32_t oldest = (header.head + capacity - header.count) % capacity;
+        for (uint32_t i = 0; i < header.count; i++) {
+            Record record;
+            if (!storage.read(offsetOf((oldest + i) % capacity), &record, sizeof(Record))) {
+                break;
+            }
+            if (record.time >= from && record.time < to && !consumer(record)) {
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Passes the records with <code>time >= from</code> to the consumer, newest first.
+     *
+     * Stops at the first older record, so that only the tail of the ring is read.
+     */
+    void queryTail(uint32_t from, std::function<void(const Record&)> consumer) {
+        for (uint32_t i = 1; i <= header.count; i++) {
+            Record record;
+            if (!storage.read(offsetOf((header.head + capacity - i) % capacity), &record, sizeof(Record))
+                || record.time < from) {
+                break;
+            }
+            consumer(record);
+        }
+    }
+
+    /**
+     * @brief The time of the oldest record, or zero if the ring is empty.
+     */
+    uint32_t oldestTime() {
+        Record record;
+        if (header.count == 0
+            || !storage.read(offsetOf((header.head + capacity - header.count) % capacity), &record, sizeof(Record))) {
+            return 0;
+        }
+        return record.time;
+    }
+
+    /**
+     * @brief The time of the newest record, or zero if the ring is empty.
+     */
+    uint32_t newestTime() {
+        Record record;
+        if (header.count == 0
+            || !storage.read(offsetOf((header.head + capacity - 1) % capacity), &record, sizeof(Record))) {
+            return 0;
+        }
+        return record.time;
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t recordSize;
+        uint32_t capacity;
+        uint32_t head;
+        uint32_t count;
+    };
+
+    // "FHTS" in little endian
+    static const uint32_t RING_MAGIC = 0x53544846;
+
+    static size_t offsetOf(uint32_t index) {
+        return sizeof(Header) + index * sizeof(Record);
+    }
+
+    RingStorage& storage;
+    const uint32_t capacity;
+    Header header { 0, 0, 0, 0, 0 };
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+#include <list>
+#include <memory>
+
+#include <TimeSeries.hpp>
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Ring storage in a SPIFFS file.
+ *
+ * The file is kept open, so that appending a record does not need to open it every time.
+ */
+class SpiffsRingStorage : public RingStorage {
+public:
+    SpiffsRingStorage(const String& path)
+        : path(path) {
+    }
+
+    bool read(size_t offset, void* buffer, size_t length) override {
+        if (!ensureOpen() || !file.seek(offset)) {
+            return false;
+        }
+        return file.read(reinterpret_cast<uint8_t*>(buffer), length) == length;
+    }
+
+    bool write(size_t offset, const void* buffer, size_t length) override {
+        if (!ensureOpen() || !file.seek(offset)) {
+            return false;
+        }
+        bool success = file.write(reinterpret_cast<const uint8_t*>(buffer), length) == length;
+        file.flush();
+        return success;
+    }
+
+private:
+    bool ensureOpen() {
+        if (!file) {
+            file = SPIFFS.open(path, SPIFFS.exists(path) ? "r+" : "w+");
+            if (!file) {
+                Serial.println("Cannot open time series file " + path);
+            }
+        }
+        return file;
+    }
+
+    const String path;
+    File file;
+};
+
+/**
+ * @brief Stores numeric telemetry fields on flash in round-robin files.
+ *
+ * Each series keeps raw samples, and rollups aggregated per minute and per hour, each in a file
+ * of fixed capacity, so that the cloud can backfill gaps in the telemetry at the resolution it needs.
+ * Time is measured in seconds since the UNIX epoch, so samples are only stored once the clock is set.
+ * The rollups still open are rebuilt from the raw samples when started, so they survive deep sleep and restarts.
+ */
+class TimeSeriesStore {
+public:
+    struct Retention {
+        // 24 hours at a heartbeat of one minute
+        uint32_t raw = 24 * 60;
+        // One day of minutes
+        uint32_t minutes = 24 * 60;
+        // Four weeks of hours
+        uint32_t hours = 4 * 7 * 24;
+    };
+
+    enum class Resolution {
+        Raw,
+        Minute,
+        Hour
+    };
+
+    TimeSeriesStore(const String& directory = "/ts")
+        : directory(directory) {
+    }
+
+    /**
+     * @brief Stores the given telemetry field; must be called before <code>begin()</code>.
+     *
+     * Takes <code>8 * raw + 20 * (minutes + hours)</code> bytes of flash plus small headers (54 kB with the default retention).
+     */
+    void addSeries(const String& field, Retention retention = Retention()) {
+        series.emplace_back(new Series(directory + "/" + field, field, retention));
+    }
+
+    void begin() {
+        for (auto& entry : series) {
+            entry->begin();
+        }
+    }
+
+    /**
+     * @brief Records the stored fields of the given telemetry; sampled fields are recorded by their mean.
+     */
+    void record(const JsonObject& telemetry, uint32_t time) {
+        for (auto& entry : series) {
+            JsonVariantConst value = telemetry[entry->field];
+            if (value.is<JsonObjectConst>()) {
+                value = value["mean"];
+            }
+            if (value.is<float>()) {
+                entry->record(time, value.as<float>());
+            }
+        }
+    }
+
+    /**
+     * @brief Adds the samples of a series to <code>response</code>, at most <code>limit</code> of them.
+     *
+     * Samples are added to <code>samples</code> as <code>[time, value]</code> pairs at raw resolution,
+     * and as <code>[time, min, max, mean, count]</code> for rollups. If there are more samples in the
+     * range, the time to continue from is added as <code>next</code>.
+     *
+     * @return false if the series is not stored.
+     */
+    bool query(const String& field, Resolution resolution, uint32_t from, uint32_t to, size_t limit, JsonObject& response) {
+        for (auto& entry : series) {
+            if (entry->field == field) {
+                entry->query(resolution, from, to, limit, response);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief The finest resolution that still has samples from the given time.
+     */
+    Resolution resolutionFor(const String& field, uint32_t from) {
+        for (auto& entry : series) {
+            if (entry->field == field) {
+                return entry->resolutionFor(from);
+            }
+        }
+        return Resolution::Raw;
+    }
+
+private:
+    class Series {
+    public:
+        Series(const String& basePath, const String& field, const Retention& retention)
+            : field(field)
+            , rawStorage(basePath + ".r")
+            , minuteStorage(basePath + ".m")
+            , hourStorage(basePath + ".h")
+            , raw(rawStorage, retention.raw)
+            , minutes(minuteStorage, retention.minutes)
+            , hours(hourStorage, retention.hours) {
+        }
+
+        void begin() {
+            raw.begin();
+            minutes.begin();
+            hours.begin();
+            minuteDownsampler.resume(raw);
+            hourDownsampler.resume(raw);
+        }
+
+        void record(uint32_t time, float value) {
+            raw.append({ time, value });
+            RollupSample completed;
+            if (minuteDownsampler.add(time, value, completed)) {
+                minutes.append(completed);
+            }
+            if (hourDownsampler.add(time, value, completed)) {
+                hours.append(completed);
+            }
+        }
+
+        Resolution resolutionFor(uint32_t from) {
+            if (raw.size() > 0 && raw.oldestTime() <= from) {
+                return Resolution::Raw;
+            } else if (minutes.size() > 0 && minutes.oldestTime() <= from) {
+                return Resolution::Minute;
+            } else {
+                return Resolution::Hour;
+            }
+        }
+
+        void query(Resolution resolution, uint32_t from, uint32_t to, size_t limit, JsonObject& response) {
+            JsonArray samples = response.createNestedArray("samples");
+            size_t count = 0;
+            switch (resolution) {
+                case Resolution::Raw:
+                    raw.query(from, to, [&](const RawSample& sample) {
+                        if (count++ == limit) {
+                            response["next"] = sample.time;
+                            return false;
+                        }
+                        JsonArray entry = samples.createNestedArray();
+                        entry.add(sample.time);
+                        entry.add(sample.value);
+                        return true;
+                    });
+                    break;
+                case Resolution::Minute:
+                case Resolution::Hour: {
+                    auto& rollups = resolution == Resolution::Minute ? minutes : hours;
+                    rollups.query(from, to, [&](const RollupSample& sample) {
+                        if (count++ == limit) {
+                            response["next"] = sample.time;
+                            return false;
+                        }
+                        JsonArray entry = samples.createNestedArray();
+                        entry.add(sample.time);
+                        entry.add(sample.min);
+                        entry.add(sample.max);
+                        entry.add(sample.mean);
+                        entry.add(sample.count);
+                        return true;
+                    });
+                    break;
+                }
+            }
+        }
+
+        const String field;
+
+    private:
+        SpiffsRingStorage rawStorage;
+        SpiffsRingStorage minuteStorage;
+        SpiffsRingStorage hourStorage;
+        RecordRing<RawSample> raw;
+        RecordRing<RollupSample> minutes;
+        RecordRing<RollupSample> hours;
+        Downsampler minuteDownsampler { 60 };
+        Downsampler hourDownsampler { 60 * 60 };
+    };
+
+    const String directory;
+    std::list<std::unique_ptr<Series>> series;
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <list>
+
+using namespace std::chrono;
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Decides how long to sleep based on when components next need the device to be awake.
+ */
+class WakePlanner {
+public:
+    struct Plan {
+        /**
+         * @brief How long to sleep, zero if we should stay awake.
+         */
+        microseconds duration;
+
+        /**
+         * @brief The name of the requirement that decided the duration, or <code>nullptr</code> if none did.
+         */
+        const char* reason;
+    };
+
+    /**
+     * @brief Registers a component that needs the device to be awake at some point.
+     *
+     * @param timeUntilWake returns how long until the device needs to be awake, or <code>microseconds::max()</code> if never.
+     */
+    void require(const char* name, std::function<microseconds()> timeUntilWake) {
+        requirements.emplace_back(name, timeUntilWake);
+    }
+
+    /**
+     * @brief Plans to sleep until the earliest requirement, but no longer than <code>maxSleep</code>.
+     *
+     * Waking up costs more than staying awake for a short while, so if the earliest requirement
+     * is due in less than <code>minSleep</code>, the plan is to stay awake.
+     */
+    Plan plan(microseconds maxSleep, microseconds minSleep) const {
+        Plan plan { maxSleep, nullptr };
+        for (auto& requirement : requirements) {
+            auto timeUntilWake = requirement.timeUntilWake();
+            if (timeUntilWake < plan.duration) {
+                plan.duration = std::max(timeUntilWake, microseconds::zero());
+                plan.reason = requirement.name;
+            }
+        }
+        if (plan.duration < minSleep) {
+            plan.duration = microseconds::zero();
+        }
+        return plan;
+    }
+
+private:
+    struct Requirement {
+        Requirement(const char* name, std::function<microseconds()> timeUntilWake)
+            : name(name)
+            , timeUntilWake(timeUntilWake) {
+        }
+
+        const char* name;
+        const std::function<microseconds()> timeUntilWake;
+    };
+
+    std::list<Requirement> requirements;
+};
+
+}}    // namespace farmhub::client
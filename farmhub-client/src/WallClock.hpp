@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+#include <BootClock.hpp>
+#include <ClockMapping.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub { namespace client {
+
+/**
+ * @brief Converts times measured via <code>boot_clock</code> to UTC.
+ *
+ * The mapping is taken from the system clock once it has been set, either by NTP,
+ * or by the RTC keeping time across deep sleep.
+ */
+class WallClock {
+public:
+    /**
+     * @brief Updates the mapping from the system clock, returns false if the system clock is not set yet.
+     */
+    static bool synchronize() {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        int64_t bootMicros = boot_clock::now().time_since_epoch().count();
+        int64_t utcMicros = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+        if (!ClockMapping::isValidUtc(utcMicros)) {
+            return false;
+        }
+        bool wasSynchronized = mapping().isSynchronized();
+        int64_t correction = mapping().synchronize(bootMicros, utcMicros);
+        if (wasSynchronized) {
+            Serial.printf("Wall clock corrected by %lld us\n", (long long) correction);
+        } else {
+            Serial.printf("Wall clock synchronized, boot time is %lld us\n", (long long) (utcMicros - bootMicros));
+        }
+        return true;
+    }
+
+    static bool isSynchronized() {
+        return mapping().isSynchronized();
+    }
+
+    /**
+     * @brief Converts a time since boot to milliseconds since the UNIX epoch, returns false if the mapping is not known yet.
+     */
+    static bool toUtcMillis(time_point<boot_clock> time, int64_t& utcMillis) {
+        return mapping().toUtcMillis(time.time_since_epoch().count(), utcMillis);
+    }
+
+private:
+    static ClockMapping& mapping() {
+        static ClockMapping instance;
+        return instance;
+    }
+};
+
+}}    // namespace farmhub::client
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Configuration.hpp>
+#include <MqttHandler.hpp>
+
+namespace farmhub { namespace client { namespace commands {
+
+class ConfigSchemaCommand : public MqttHandler::Command {
+public:
+    ConfigSchemaCommand(const Configuration& appConfig, const Configuration& deviceConfig)
+        : appConfig(appConfig)
+        , deviceConfig(deviceConfig) {
+    }
+
+    void handle(const JsonObject& request, JsonObject& response) override {
+        const Configuration* config = select(request);
+        if (config == nullptr) {
+            response["error"] = "Unknown configuration: " + String(request["config"] | "");
+            return;
+        }
+        JsonObject schema = response.createNestedObject("schema");
+        config->describe(schema);
+    }
+
+    size_t responseCapacity(const JsonObject& request) override {
+        const Configuration* config = select(request);
+        if (config == nullptr) {
+            return MqttHandler::Command::responseCapacity(request);
+        }
+        return JSON_OBJECT_SIZE(1) + config->schemaCapacity();
+    }
+
+private:
+    const Configuration* select(const JsonObject& request) const {
+        String config = request["config"] | "application";
+        if (config == "application") {
+            return &appConfig;
+        } else if (config == "device") {
+            return &deviceConfig;
+        } else {
+            return nullptr;
+        }
+    }
+
+    const Configuration& appConfig;
+    const Configuration& deviceConfig;
+};
+
+}}}    // namespace farmhub::client::commands
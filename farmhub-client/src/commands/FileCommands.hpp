@@ -2,8 +2,19 @@
 
 #include <ArduinoJson.h>
 #include <SPIFFS.h>
+#include <esp_rom_crc.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha256.h>
+#include <memory>
 
 #include <MqttHandler.hpp>
+#include <commands/RawChunk.hpp>
+
+// Maximum number of bytes transferred in a single chunk, so that
+// the encoded chunk and its metadata fit into MQTT_BUFFER_SIZE
+#define FILE_CHUNK_SIZE_MAX 1024
+// Size of the largest chunk encoded as base64; raw chunks are shortened to fit into the same space once escaped
+#define FILE_CHUNK_ENCODED_SIZE_MAX (4 * ((FILE_CHUNK_SIZE_MAX + 2) / 3))
 
 namespace farmhub { namespace client { namespace commands {
 
@@ -28,44 +39,275 @@ public:
     }
 };
 
-class FileReadCommand : public MqttHandler::Command {
-public:
-    void handle(const JsonObject& request, JsonObject& response) override {
+/**
+ * @brief Common functionality for transferring files in chunks.
+ *
+ * Chunks are encoded either as "raw" (the bytes are sent as a JSON string as-is,
+ * suitable for text files), or as "base64" (suitable for binary content).
+ * JSON strings end at the first zero byte, so chunks containing one must use base64.
+ * Each chunk is accompanied by its CRC32 checksum, and the SHA-256 hash of the whole
+ * file is reported once the last chunk has been transferred.
+ */
+class FileTransferCommand : public MqttHandler::Command {
+protected:
+    enum class Encoding {
+        Raw,
+        Base64
+    };
+
+    static String resolvePath(const JsonObject& request) {
         String path = request["path"];
         if (!path.startsWith("/")) {
             path = "/" + path;
         }
-        Serial.printf("Reading %s\n", path.c_str());
+        return path;
+    }
+
+    static bool parseEncoding(const JsonObject& request, Encoding& encoding) {
+        String value = request["encoding"] | "raw";
+        if (value == "raw") {
+            encoding = Encoding::Raw;
+        } else if (value == "base64") {
+            encoding = Encoding::Base64;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static uint32_t crc32(const uint8_t* data, size_t length) {
+        return esp_rom_crc32_le(0, data, length);
+    }
+
+    /**
+     * @brief Calculates the hex-encoded SHA-256 hash of the whole file.
+     */
+    static String sha256(File& file) {
+        mbedtls_sha256_context context;
+        mbedtls_sha256_init(&context);
+        mbedtls_sha256_starts_ret(&context, 0);
+
+        file.seek(0);
+        uint8_t buffer[256];
+        while (true) {
+            size_t read = file.read(buffer, sizeof(buffer));
+            if (read == 0) {
+                break;
+            }
+            mbedtls_sha256_update_ret(&context, buffer, read);
+        }
+
+        uint8_t hash[32];
+        mbedtls_sha256_finish_ret(&context, hash);
+        mbedtls_sha256_free(&context);
+
+        char hex[sizeof(hash) * 2 + 1];
+        for (size_t i = 0; i < sizeof(hash); i++) {
+            sprintf(hex + i * 2, "%02x", hash[i]);
+        }
+        return String(hex);
+    }
+};
+
+/**
+ * @brief Reads a chunk of a file.
+ *
+ * Request parameters:
+ *
+ * - <code>path</code> -- the file to read,
+ * - <code>offset</code> -- where to start reading, defaults to 0,
+ * - <code>length</code> -- the maximum number of bytes to read, defaults to <code>FILE_CHUNK_SIZE_MAX</code>,
+ * - <code>encoding</code> -- "raw" (default) or "base64"; reading a chunk with a zero byte as "raw" fails.
+ *
+ * Raw chunks can be shorter than requested, so that they fit into a message once escaped,
+ * and do not end in the middle of a UTF-8 character. Continue from <code>offset + length</code>.
+ */
+class FileReadCommand : public FileTransferCommand {
+public:
+    void handle(const JsonObject& request, JsonObject& response) override {
+        String path = resolvePath(request);
+        size_t offset = request["offset"] | 0;
+        int requestedLength = request["length"] | FILE_CHUNK_SIZE_MAX;
+        size_t length = requestedLength > 0 && requestedLength < FILE_CHUNK_SIZE_MAX
+            ? requestedLength
+            : FILE_CHUNK_SIZE_MAX;
+        Serial.printf("Reading %s (offset: %d, length: %d)\n", path.c_str(), offset, length);
         response["path"] = path;
+
+        Encoding encoding;
+        if (!parseEncoding(request, encoding)) {
+            response["error"] = "Unknown encoding";
+            return;
+        }
+
         File file = SPIFFS.open(path, FILE_READ);
-        if (file) {
-            response["size"] = file.size();
-            response["contents"] = file.readString();
-        } else {
+        if (!file) {
             response["error"] = "File not found";
+            return;
         }
+
+        size_t size = file.size();
+        response["size"] = size;
+        response["offset"] = offset;
+        if (offset > size) {
+            response["error"] = "Offset beyond end of file";
+            file.close();
+            return;
+        }
+
+        // Leave room for the terminating zero when sending raw contents
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[length + 1]);
+        file.seek(offset);
+        size_t read = file.read(buffer.get(), length);
+        buffer[read] = 0;
+        if (encoding == Encoding::Raw && memchr(buffer.get(), 0, read) != nullptr) {
+            // The contents would be cut short, and would not match the length and the CRC
+            response["error"] = "Binary contents, use base64 encoding";
+            file.close();
+            return;
+        }
+        if (encoding == Encoding::Raw) {
+            size_t fitting = RawChunk::fit(buffer.get(), read, FILE_CHUNK_ENCODED_SIZE_MAX, offset + read < size);
+            if (fitting == 0 && read > 0) {
+                response["error"] = "Contents too large when escaped, use base64 encoding";
+                file.close();
+                return;
+            }
+            read = fitting;
+            buffer[read] = 0;
+        }
+        response["length"] = read;
+        response["crc32"] = crc32(buffer.get(), read);
+
+        switch (encoding) {
+            case Encoding::Raw:
+                // Pass non-const pointer so ArduinoJson makes a copy
+                response["contents"] = reinterpret_cast<char*>(buffer.get());
+                break;
+            case Encoding::Base64: {
+                size_t encodedLength;
+                // Query the required length first
+                mbedtls_base64_encode(nullptr, 0, &encodedLength, buffer.get(), read);
+                std::unique_ptr<uint8_t[]> encoded(new uint8_t[encodedLength]);
+                mbedtls_base64_encode(encoded.get(), encodedLength, &encodedLength, buffer.get(), read);
+                response["encoding"] = "base64";
+                response["contents"] = reinterpret_cast<char*>(encoded.get());
+                break;
+            }
+        }
+
+        bool eof = offset + read >= size;
+        response["eof"] = eof;
+        if (eof) {
+            response["sha256"] = sha256(file);
+        }
+        file.close();
     }
 };
 
-class FileWriteCommand : public MqttHandler::Command {
+/**
+ * @brief Writes a chunk of a file.
+ *
+ * Request parameters:
+ *
+ * - <code>path</code> -- the file to write,
+ * - <code>contents</code> -- the chunk to write,
+ * - <code>offset</code> -- where the chunk starts, defaults to 0; writing at offset 0 truncates the file,
+ *   any other offset must match the current size of the file,
+ * - <code>encoding</code> -- "raw" (default) or "base64",
+ * - <code>crc32</code> -- optional CRC32 of the decoded chunk; the chunk is rejected if it doesn't match,
+ * - <code>sha256</code> -- optional SHA-256 hash of the whole file to verify after writing the last chunk.
+ *
+ * When the offset does not match, the current size of the file is returned,
+ * so that the transfer can be resumed from there.
+ */
+class FileWriteCommand : public FileTransferCommand {
 public:
     void handle(const JsonObject& request, JsonObject& response) override {
-            String path = request["path"];
-            if (!path.startsWith("/")) {
-                path = "/" + path;
+        String path = resolvePath(request);
+        size_t offset = request["offset"] | 0;
+        Serial.printf("Writing %s (offset: %d)\n", path.c_str(), offset);
+        response["path"] = path;
+        response["offset"] = offset;
+
+        Encoding encoding;
+        if (!parseEncoding(request, encoding)) {
+            response["error"] = "Unknown encoding";
+            return;
+        }
+
+        const char* contents = request["contents"] | "";
+        size_t contentsLength = strlen(contents);
+        std::unique_ptr<uint8_t[]> decoded;
+        const uint8_t* data;
+        size_t length;
+        switch (encoding) {
+            case Encoding::Raw:
+                data = reinterpret_cast<const uint8_t*>(contents);
+                length = contentsLength;
+                break;
+            case Encoding::Base64: {
+                // Decoded data is always shorter than the encoded text
+                decoded.reset(new uint8_t[contentsLength + 1]);
+                if (mbedtls_base64_decode(decoded.get(), contentsLength + 1, &length, reinterpret_cast<const uint8_t*>(contents), contentsLength) != 0) {
+                    response["error"] = "Invalid base64 contents";
+                    return;
+                }
+                data = decoded.get();
+                break;
             }
-            Serial.printf("Writing %s\n", path.c_str());
-            String contents = request["contents"];
-            response["path"] = path;
-            File file = SPIFFS.open(path, FILE_WRITE);
-            if (file) {
-                auto written = file.print(contents);
-                file.flush();
-                response["written"] = written;
-                file.close();
-            } else {
-                response["error"] = "File not found";
+        }
+
+        if (request.containsKey("crc32")) {
+            uint32_t expectedCrc = request["crc32"];
+            uint32_t actualCrc = crc32(data, length);
+            if (expectedCrc != actualCrc) {
+                response["error"] = "CRC32 mismatch";
+                response["crc32"] = actualCrc;
+                return;
+            }
+        }
+
+        File file;
+        if (offset == 0) {
+            file = SPIFFS.open(path, FILE_WRITE);
+        } else {
+            size_t currentSize = 0;
+            if (SPIFFS.exists(path)) {
+                File existing = SPIFFS.open(path, FILE_READ);
+                currentSize = existing.size();
+                existing.close();
+            }
+            if (currentSize != offset) {
+                response["error"] = "Offset does not match file size";
+                response["size"] = currentSize;
+                return;
             }
+            file = SPIFFS.open(path, FILE_APPEND);
+        }
+        if (!file) {
+            response["error"] = "File not found";
+            return;
+        }
+
+        auto written = file.write(data, length);
+        file.flush();
+        file.close();
+        response["written"] = written;
+        response["size"] = offset + written;
+
+        if (request.containsKey("sha256")) {
+            String expectedHash = request["sha256"];
+            File verifiedFile = SPIFFS.open(path, FILE_READ);
+            String actualHash = sha256(verifiedFile);
+            verifiedFile.close();
+            response["sha256"] = actualHash;
+            bool verified = expectedHash.equalsIgnoreCase(actualHash);
+            response["verified"] = verified;
+            if (!verified) {
+                response["error"] = "SHA-256 mismatch";
+            }
+        }
     }
 };
 
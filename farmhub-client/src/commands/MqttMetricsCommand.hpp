@@ -0,0 +1,27 @@
+#pragma once
+
+#include <MqttHandler.hpp>
+
+namespace farmhub { namespace client { namespace commands {
+
+class MqttMetricsCommand : public MqttHandler::Command {
+public:
+    MqttMetricsCommand(MqttHandler& mqtt)
+        : mqtt(mqtt) {
+    }
+
+    void handle(const JsonObject& request, JsonObject& response) override {
+        mqtt.getMetrics().populate(response);
+        response["freeHeap"] = ESP.getFreeHeap();
+        response["minFreeHeap"] = ESP.getMinFreeHeap();
+        if (request["reset"] | false) {
+            mqtt.resetMetrics();
+            response["reset"] = true;
+        }
+    }
+
+private:
+    MqttHandler& mqtt;
+};
+
+}}}    // namespace farmhub::client::commands
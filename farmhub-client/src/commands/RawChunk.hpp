@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace farmhub { namespace client { namespace commands {
+
+/**
+ * @brief Fits a chunk of a text file into a JSON string of limited size.
+ *
+ * Quotes, backslashes and whitespace escapes take up two bytes in a JSON string,
+ * and other control characters six, so a raw chunk can grow considerably when sent.
+ */
+class RawChunk {
+public:
+    /**
+     * @brief Returns the number of bytes the given byte takes up in a JSON string.
+     */
+    static size_t escapedSize(uint8_t c) {
+        switch (c) {
+            case '"':
+            case '\\':
+            case '\b':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+                return 2;
+            default:
+                // Written as \u00XX
+                return c < 0x20 ? 6 : 1;
+        }
+    }
+
+    /**
+     * @brief Returns how many bytes from the start of the chunk to send, so that they take up at most
+     * <code>maxEscapedSize</code> bytes escaped, and no UTF-8 sequence is split between chunks.
+     *
+     * @param more whether the file continues after the chunk; the end of the file is never trimmed.
+     * @return zero if not even a single character fits.
+     */
+    static size_t fit(const uint8_t* data, size_t length, size_t maxEscapedSize, bool more) {
+        size_t fitting = 0;
+        size_t escaped = 0;
+        while (fitting < length) {
+            escaped += escapedSize(data[fitting]);
+            if (escaped > maxEscapedSize) {
+                break;
+            }
+            fitting++;
+        }
+        if (fitting == length && !more) {
+            return fitting;
+        }
+        return trimToCharacter(data, fitting);
+    }
+
+private:
+    /**
+     * @brief Drops an incomplete UTF-8 sequence from the end of the chunk.
+     *
+     * Text that is not valid UTF-8 is left as is, so that it can still be transferred.
+     */
+    static size_t trimToCharacter(const uint8_t* data, size_t length) {
+        // Find the start of the last sequence, at most four bytes back
+        size_t start = length;
+        while (start > 0 && length - start < 4 && (data[start - 1] & 0xC0) == 0x80) {
+            start--;
+        }
+        if (start == 0) {
+            return length;
+        }
+        uint8_t lead = data[start - 1];
+        size_t sequenceLength;
+        if ((lead & 0x80) == 0x00) {
+            return length;
+        } else if ((lead & 0xE0) == 0xC0) {
+            sequenceLength = 2;
+        } else if ((lead & 0xF0) == 0xE0) {
+            sequenceLength = 3;
+        } else if ((lead & 0xF8) == 0xF0) {
+            sequenceLength = 4;
+        } else {
+            return length;
+        }
+        size_t available = length - (start - 1);
+        if (available >= sequenceLength || start - 1 == 0) {
+            return length;
+        }
+        return start - 1;
+    }
+};
+
+}}}    // namespace farmhub::client::commands
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <list>
+
+#include <MqttHandler.hpp>
+#include <Telemetry.hpp>
+
+namespace farmhub { namespace client { namespace commands {
+
+/**
+ * @brief Reports how long each telemetry provider takes to populate its telemetry, grouped by topic.
+ */
+class TelemetryMetricsCommand : public MqttHandler::Command {
+public:
+    void addPublisher(TelemetryPublisher& publisher) {
+        publishers.push_back(std::ref(publisher));
+    }
+
+    void handle(const JsonObject& request, JsonObject& response) override {
+        for (auto& publisher : publishers) {
+            JsonObject metrics = response.createNestedObject(publisher.get().getTopic());
+            publisher.get().populateMetrics(metrics);
+        }
+    }
+
+private:
+    std::list<std::reference_wrapper<TelemetryPublisher>> publishers;
+};
+
+}}}    // namespace farmhub::client::commands
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <MqttHandler.hpp>
+#include <TimeSeriesStore.hpp>
+
+// Maximum number of samples returned in a single response, so that it fits into the response document and MQTT_BUFFER_SIZE
+#define TELEMETRY_QUERY_LIMIT_MAX 16
+
+namespace farmhub { namespace client { namespace commands {
+
+/**
+ * @brief Returns stored samples of a telemetry field.
+ *
+ * Request parameters:
+ *
+ * - <code>field</code> -- the telemetry field to query,
+ * - <code>from</code> -- start of the range in seconds since the UNIX epoch (inclusive), defaults to 0,
+ * - <code>to</code> -- end of the range in seconds since the UNIX epoch (exclusive), defaults to now,
+ * - <code>resolution</code> -- "raw", "minute" or "hour"; defaults to the finest resolution still available at <code>from</code>,
+ * - <code>limit</code> -- the maximum number of samples to return, defaults to <code>TELEMETRY_QUERY_LIMIT_MAX</code>.
+ *
+ * When there are more samples in the range than the limit, <code>next</code> is returned to continue from.
+ */
+class TelemetryQueryCommand : public MqttHandler::Command {
+public:
+    TelemetryQueryCommand(TimeSeriesStore& store)
+        : store(store) {
+    }
+
+    void handle(const JsonObject& request, JsonObject& response) override {
+        String field = request["field"] | "";
+        uint32_t from = request["from"] | 0;
+        uint32_t to = request["to"] | static_cast<uint32_t>(time(nullptr) + 1);
+        int requestedLimit = request["limit"] | TELEMETRY_QUERY_LIMIT_MAX;
+        size_t limit = requestedLimit > 0 && requestedLimit < TELEMETRY_QUERY_LIMIT_MAX
+            ? requestedLimit
+            : TELEMETRY_QUERY_LIMIT_MAX;
+
+        TimeSeriesStore::Resolution resolution;
+        String requestedResolution = request["resolution"] | "";
+        if (requestedResolution.isEmpty()) {
+            resolution = store.resolutionFor(field, from);
+        } else if (requestedResolution == "raw") {
+            resolution = TimeSeriesStore::Resolution::Raw;
+        } else if (requestedResolution == "minute") {
+            resolution = TimeSeriesStore::Resolution::Minute;
+        } else if (requestedResolution == "hour") {
+            resolution = TimeSeriesStore::Resolution::Hour;
+        } else {
+            response["error"] = "Unknown resolution";
+            return;
+        }
+
+        response["field"] = field;
+        response["resolution"] = resolution == TimeSeriesStore::Resolution::Raw
+            ? "raw"
+            : resolution == TimeSeriesStore::Resolution::Minute
+            ? "minute"
+            : "hour";
+        if (!store.query(field, resolution, from, to, limit, response)) {
+            response["error"] = "Field is not stored";
+        }
+    }
+
+private:
+    TimeSeriesStore& store;
+};
+
+}}}    // namespace farmhub::client::commands
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <MqttHandler.hpp>
+#include <wifi/WiFiProvider.hpp>
+
+namespace farmhub { namespace client { namespace commands {
+
+class WiFiMetricsCommand : public MqttHandler::Command {
+public:
+    WiFiMetricsCommand(WiFiProvider& wifiProvider)
+        : wifiProvider(wifiProvider) {
+    }
+
+    void handle(const JsonObject& request, JsonObject& response) override {
+        wifiProvider.getMetrics().populate(response);
+    }
+
+private:
+    WiFiProvider& wifiProvider;
+};
+
+}}}    // namespace farmhub::client::commands
@@ -1,15 +1,42 @@
 #pragma once
 
+#include <Preferences.h>
 #include <WiFi.h>
 #include <WiFiManager.h>
+#include <atomic>
 #include <chrono>
+#include <esp_wifi.h>
+#include <sys/time.h>
 
+#include <BootClock.hpp>
+#include <ClockMapping.hpp>
+#include <RtcRecord.hpp>
 #include <wifi/WiFiProvider.hpp>
 
 using namespace std::chrono;
 
 namespace farmhub { namespace client {
 
+/**
+ * @brief The access point and IP lease used last time, to connect without scanning next time.
+ */
+struct WiFiConnectionCache {
+    uint8_t bssid[6];
+    uint8_t channel;
+    // IPv4 addresses as stored by IPAddress, zero if unknown
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    // UTC seconds when DHCP handed out the lease, zero if unknown
+    uint32_t leaseObtainedAt;
+};
+
+using WiFiConnectionCacheRecord = RtcRecord<WiFiConnectionCache, 40>;
+
+RTC_DATA_ATTR
+WiFiConnectionCacheRecord::Slot wifiConnectionCacheSlot;
+
 class AbstractWiFiManagerProvider
     : public WiFiProvider {
 public:
@@ -18,7 +45,14 @@ public:
         , configurationTimeout(configurationTimeout) {
     }
 
-    virtual void begin(const String& hostname) override {
+    virtual void begin(const String& hostname, const Config& config) override {
+        this->config = &config;
+
+        // Must store hostname, because WiFiManager won't make a copy
+        this->hostname = hostname;
+        // Set before starting WiFi so that it is used when connecting directly too
+        WiFi.setHostname(this->hostname.c_str());
+
         // Explicitly set mode, ESP defaults to STA+AP
         WiFi.mode(WIFI_STA);
 
@@ -26,8 +60,6 @@ public:
         // these are stored by the ESP library
         // wm.resetSettings();
 
-        // Must store hostname, because WiFiManager won't make a copy
-        this->hostname = hostname;
         wm.setHostname(this->hostname.c_str());
 
         // Allow some time for connecting to the WIFI, otherwise
@@ -43,12 +75,191 @@ public:
 
     void resetSettings() {
         wm.resetSettings();
+        cacheRecord.clear();
+        Preferences preferences;
+        preferences.begin(NVS_NAMESPACE, false);
+        preferences.clear();
+        preferences.end();
     }
 
 protected:
+    /**
+     * @brief Starts connecting directly to the access point used last time, returns false if it is not known.
+     *
+     * The access point is remembered in RTC memory across deep sleep, and in NVS across power cycles.
+     */
+    bool startFastConnect() {
+        if (!config->fastConnect.get()) {
+            return false;
+        }
+        WiFiConnectionCache cache;
+        if (!cacheRecord.restore(cache) && !loadFromNvs(cache)) {
+            return false;
+        }
+        wifi_config_t stationConfig;
+        if (esp_wifi_get_config(WIFI_IF_STA, &stationConfig) != ESP_OK || stationConfig.sta.ssid[0] == 0) {
+            return false;
+        }
+
+        reusingIpLease = config->reuseIpLease.get() && isLeaseReusable(cache);
+        if (reusingIpLease) {
+            reusedLease = cache;
+            WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+        }
+
+        Serial.printf("WiFi: connecting directly to %02x:%02x:%02x:%02x:%02x:%02x on channel %d%s\n",
+            cache.bssid[0], cache.bssid[1], cache.bssid[2], cache.bssid[3], cache.bssid[4], cache.bssid[5],
+            cache.channel, reusingIpLease ? " reusing IP lease" : "");
+        // Pin the access point in RAM only, so that the stored credentials still work with other access points
+        stationConfig.sta.bssid_set = true;
+        memcpy(stationConfig.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        stationConfig.sta.channel = cache.channel;
+        esp_wifi_set_storage(WIFI_STORAGE_RAM);
+        esp_wifi_set_config(WIFI_IF_STA, &stationConfig);
+        esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+
+        connectStartTime = boot_clock::now();
+        fastConnecting = true;
+        if (esp_wifi_connect() != ESP_OK) {
+            abandonFastConnect();
+            return false;
+        }
+        return true;
+    }
+
+    bool isFastConnectTimedOut() const {
+        return boot_clock::now() - connectStartTime > config->fastConnectTimeout.get();
+    }
+
+    /**
+     * @brief Gives up on the direct connection, and forgets the access point.
+     */
+    void abandonFastConnect() {
+        Serial.println("WiFi: could not connect directly, falling back to scanning");
+        fastConnecting = false;
+        reusingIpLease = false;
+        metrics.fastConnectFailures++;
+        cacheRecord.clear();
+
+        esp_wifi_disconnect();
+        wifi_config_t stationConfig;
+        if (esp_wifi_get_config(WIFI_IF_STA, &stationConfig) == ESP_OK) {
+            stationConfig.sta.bssid_set = false;
+            stationConfig.sta.channel = 0;
+            esp_wifi_set_storage(WIFI_STORAGE_RAM);
+            esp_wifi_set_config(WIFI_IF_STA, &stationConfig);
+            esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+        }
+        // Back to DHCP
+        WiFi.config(IPAddress((uint32_t) 0), IPAddress((uint32_t) 0), IPAddress((uint32_t) 0));
+    }
+
+    /**
+     * @brief Records how long connecting took, and remembers the access point and IP lease for next time.
+     */
+    void connected(time_point<boot_clock> connectedAt = boot_clock::now()) {
+        auto connectTime = duration_cast<microseconds>(connectedAt - connectStartTime);
+        metrics.lastConnectTime = connectTime;
+        metrics.lastConnectFast = fastConnecting;
+        if (fastConnecting) {
+            metrics.fastConnects++;
+        } else {
+            metrics.fullConnects++;
+        }
+        Serial.printf("WiFi: connected %s in %ld ms\n",
+            fastConnecting ? "directly" : "after scanning", (long) duration_cast<milliseconds>(connectTime).count());
+        fastConnecting = false;
+
+        WiFiConnectionCache cache = {};
+        memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+        cache.channel = WiFi.channel();
+        if (reusingIpLease) {
+            // Keep the lease as DHCP handed it out, so that it still expires
+            cache.ip = reusedLease.ip;
+            cache.gateway = reusedLease.gateway;
+            cache.subnet = reusedLease.subnet;
+            cache.dns = reusedLease.dns;
+            cache.leaseObtainedAt = reusedLease.leaseObtainedAt;
+            reusingIpLease = false;
+        } else {
+            cache.ip = WiFi.localIP();
+            cache.gateway = WiFi.gatewayIP();
+            cache.subnet = WiFi.subnetMask();
+            cache.dns = WiFi.dnsIP();
+            cache.leaseObtainedAt = utcSeconds();
+        }
+        cacheRecord.save(cache);
+        saveToNvs(cache);
+    }
+
     const seconds connectionTimeout;
     const seconds configurationTimeout;
+    const Config* config;
     String hostname;
+    time_point<boot_clock> connectStartTime;
+    bool fastConnecting = false;
+
+private:
+    /**
+     * @brief Returns whether the IP lease is recent enough to configure statically instead of asking DHCP.
+     */
+    bool isLeaseReusable(const WiFiConnectionCache& cache) const {
+        if (cache.ip == 0) {
+            return false;
+        }
+        // Without a clock the age of the lease is unknown, e.g. after a power cycle
+        uint32_t now = utcSeconds();
+        if (cache.leaseObtainedAt == 0 || now == 0 || now < cache.leaseObtainedAt) {
+            return false;
+        }
+        if (seconds { now - cache.leaseObtainedAt } >= config->ipLeaseMaxAge.get()) {
+            Serial.println("WiFi: IP lease is too old to reuse, asking DHCP");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns the current UTC time in seconds, or zero if the system clock is not set.
+     */
+    static uint32_t utcSeconds() {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        int64_t utcMicros = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+        return ClockMapping::isValidUtc(utcMicros) ? static_cast<uint32_t>(tv.tv_sec) : 0;
+    }
+
+    static bool loadFromNvs(WiFiConnectionCache& cache) {
+        Preferences preferences;
+        if (!preferences.begin(NVS_NAMESPACE, true)) {
+            return false;
+        }
+        bool loaded = preferences.getBytesLength(NVS_KEY) == sizeof(cache)
+            && preferences.getBytes(NVS_KEY, &cache, sizeof(cache)) == sizeof(cache);
+        preferences.end();
+        return loaded;
+    }
+
+    // Only written when something changes to spare the flash
+    static void saveToNvs(const WiFiConnectionCache& cache) {
+        WiFiConnectionCache stored;
+        if (loadFromNvs(stored) && memcmp(&stored, &cache, sizeof(cache)) == 0) {
+            return;
+        }
+        Preferences preferences;
+        preferences.begin(NVS_NAMESPACE, false);
+        preferences.putBytes(NVS_KEY, &cache, sizeof(cache));
+        preferences.end();
+    }
+
+    static constexpr const char* NVS_NAMESPACE = "wifi";
+    // Bump when the layout of WiFiConnectionCache changes
+    static constexpr const char* NVS_KEY = "cache2";
+
+    WiFiConnectionCacheRecord cacheRecord { wifiConnectionCacheSlot, 2 };
+    // The lease configured statically by the ongoing fast connect
+    bool reusingIpLease = false;
+    WiFiConnectionCache reusedLease;
 };
 
 class BlockingWiFiManagerProvider
@@ -60,13 +271,25 @@ public:
         : AbstractWiFiManagerProvider(connectionTimeout, configurationTimeout) {
     }
 
-    virtual void begin(const String& hostname) override {
-        AbstractWiFiManagerProvider::begin(hostname);
+    virtual void begin(const String& hostname, const Config& config) override {
+        AbstractWiFiManagerProvider::begin(hostname, config);
 
         // Close the configuration portal after some time and reboot
         // if no WIFI is configured in that time
         wm.setConfigPortalTimeout(configurationTimeout.count());
 
+        if (startFastConnect()) {
+            while (!WiFi.isConnected() && !isFastConnectTimedOut()) {
+                delay(10);
+            }
+            if (WiFi.isConnected()) {
+                connected();
+                return;
+            }
+            abandonFastConnect();
+        }
+        connectStartTime = boot_clock::now();
+
         // Automatically connect using saved credentials,
         // if connection fails, it starts an access point
         // with the host name for SSID and no password,
@@ -75,9 +298,17 @@ public:
         if (!wm.autoConnect(hostname.c_str())) {
             fatalError("Failed to connect to WIFI");
         }
+        connected();
     }
 };
 
+/**
+ * @brief Connects to WiFi in the background without ever blocking the other tasks.
+ *
+ * Connection attempts are started, and their outcome is picked up from WiFi events.
+ * If the stored access point cannot be reached within the connection timeout, the configuration portal
+ * is started, and served incrementally until it times out, after which the stored access point is tried again.
+ */
 class NonBlockingWiFiManagerProvider
     : public AbstractWiFiManagerProvider,
       public BaseTask {
@@ -93,58 +324,151 @@ public:
 
     enum class State {
         UNINITIALIZED,
-        INITIALIZED,
+        FAST_CONNECTING,
+        CONNECTING,
         CONFIGURING,
         CONNECTED
     };
 
-    virtual void begin(const String& hostname) override {
-        AbstractWiFiManagerProvider::begin(hostname);
+    virtual void begin(const String& hostname, const Config& config) override {
+        AbstractWiFiManagerProvider::begin(hostname, config);
 
         wm.setConfigPortalBlocking(false);
-        state = State::INITIALIZED;
+
+        // Events arrive on the WiFi event task, the rest is handled in loop()
+        WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+            gotIpAt = boot_clock::now();
+            gotIp = true;
+        },
+            ARDUINO_EVENT_WIFI_STA_GOT_IP);
+        WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+            disconnectReason = info.wifi_sta_disconnected.reason;
+            disconnected = true;
+        },
+            ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+
+        if (startFastConnect()) {
+            state = State::FAST_CONNECTING;
+        } else {
+            startConnecting();
+        }
+    }
+
+    State getState() const {
+        return state;
     }
 
 protected:
     virtual const Schedule loop(const Timing& timing) override {
-        if (state == State::UNINITIALIZED) {
-            return sleepFor(seconds { 1 });
-        }
-        if (WiFi.isConnected()) {
-            state = State::CONNECTED;
-            return sleepAtMost(connectionCheckInterval);
-        }
+        bool justConnected = gotIp.exchange(false);
+        bool justDisconnected = disconnected.exchange(false);
 
-        auto now = boot_clock::now();
-        if (state == State::CONFIGURING) {
-            auto configurationTime = now - configurationStartTime;
-            if (configurationTime < configurationTimeout) {
-                wm.process();
-                return sleepFor(milliseconds { 100 });
-            }
-            Serial.println("WiFi: configuration timed out, trying to fall back to stored configuration");
-            wm.stopConfigPortal();
-            state = State::INITIALIZED;
-        }
+        switch (state) {
+            case State::UNINITIALIZED:
+                return sleepFor(seconds { 1 });
 
-        // automatically connect using saved credentials if they exist
-        // If connection fails it starts an access point with the specified name
-        Serial.println("WiFi: trying to connect using stored credentials");
-        if (wm.autoConnect(hostname.c_str())) {
-            Serial.println("WiFi: connected to WIFI");
-            state = State::CONNECTED;
-        } else {
-            Serial.println("WiFi: configuration portal started, timeout: " + String((int) configurationTimeout.count()) + " seconds");
-            configurationStartTime = now;
-            state = State::CONFIGURING;
+            case State::FAST_CONNECTING:
+                if (justConnected) {
+                    return finishConnecting(gotIpAt);
+                }
+                if (justDisconnected) {
+                    Serial.printf("WiFi: direct connection failed, reason: %d\n", (int) disconnectReason);
+                } else if (!isFastConnectTimedOut()) {
+                    // Check often so that the connect time is measured precisely
+                    return sleepFor(milliseconds { 10 });
+                }
+                abandonFastConnect();
+                startConnecting();
+                return sleepFor(POLL_INTERVAL);
+
+            case State::CONNECTING:
+                if (justConnected) {
+                    return finishConnecting(gotIpAt);
+                }
+                // The event may have been consumed while we were still connected
+                if (WiFi.isConnected()) {
+                    return finishConnecting(boot_clock::now());
+                }
+                // Failed attempts are retried by the WiFi library until we time out
+                if (boot_clock::now() - connectStartTime < connectionTimeout) {
+                    return sleepFor(POLL_INTERVAL);
+                }
+                Serial.println("WiFi: could not connect using stored credentials");
+                startConfigPortal();
+                return sleepFor(POLL_INTERVAL);
+
+            case State::CONFIGURING:
+                // Serves a single request at most
+                if (wm.process()) {
+                    return finishConnecting(boot_clock::now());
+                }
+                if (justConnected) {
+                    // The stored access point came back while configuring
+                    wm.stopConfigPortal();
+                    return finishConnecting(gotIpAt);
+                }
+                if (boot_clock::now() - configurationStartTime < configurationTimeout) {
+                    return sleepFor(POLL_INTERVAL);
+                }
+                Serial.println("WiFi: configuration timed out, trying to fall back to stored configuration");
+                wm.stopConfigPortal();
+                startConnecting();
+                return sleepFor(POLL_INTERVAL);
+
+            case State::CONNECTED:
+                if (justConnected || WiFi.isConnected()) {
+                    if (justDisconnected) {
+                        Serial.printf("WiFi: reconnected after connection lost, reason: %d\n", (int) disconnectReason);
+                    }
+                    return sleepAtMost(connectionCheckInterval);
+                }
+                Serial.printf("WiFi: connection lost, reason: %d\n", (int) disconnectReason);
+                // The WiFi library reconnects on its own, give it some time before opening the portal
+                connectStartTime = boot_clock::now();
+                state = State::CONNECTING;
+                return sleepFor(POLL_INTERVAL);
         }
-        return sleepFor(milliseconds { 100 });
+        return sleepFor(POLL_INTERVAL);
     }
 
 private:
+    const Schedule finishConnecting(time_point<boot_clock> connectedAt) {
+        connected(connectedAt);
+        state = State::CONNECTED;
+        return sleepAtMost(connectionCheckInterval);
+    }
+
+    void startConnecting() {
+        if (!wm.getWiFiIsSaved()) {
+            Serial.println("WiFi: no stored credentials");
+            startConfigPortal();
+            return;
+        }
+        Serial.println("WiFi: trying to connect using stored credentials");
+        connectStartTime = boot_clock::now();
+        state = State::CONNECTING;
+        WiFi.begin();
+    }
+
+    void startConfigPortal() {
+        Serial.println("WiFi: configuration portal started, timeout: " + String((int) configurationTimeout.count()) + " seconds");
+        configurationStartTime = boot_clock::now();
+        state = State::CONFIGURING;
+        // Returns immediately, requests are served by process()
+        wm.startConfigPortal(hostname.c_str());
+    }
+
+    const milliseconds POLL_INTERVAL { 100 };
+
     const seconds connectionCheckInterval;
     State state = State::UNINITIALIZED;
     time_point<boot_clock> configurationStartTime;
+
+    std::atomic<bool> gotIp { false };
+    std::atomic<bool> disconnected { false };
+    // Written before the flags above are set
+    time_point<boot_clock> gotIpAt;
+    uint8_t disconnectReason = 0;
 };
 
 }}    // namespace farmhub::client
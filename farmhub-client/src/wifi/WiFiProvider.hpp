@@ -1,17 +1,65 @@
 #pragma once
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+
+#include <Configuration.hpp>
+
+using namespace std::chrono;
 
 namespace farmhub { namespace client {
 
 class WiFiProvider {
 public:
-    virtual void begin(const String& hostname) = 0;
+    class Config : public NamedConfigurationSection {
+    public:
+        Config(ConfigurationSection* parent)
+            : NamedConfigurationSection(parent, "wifi") {
+        }
+
+        // Connect directly to the access point used last time, without scanning
+        Property<bool> fastConnect { this, "fastConnect", true };
+        // Fall back to a full connection if the fast one takes longer than this
+        Property<milliseconds> fastConnectTimeout { this, "fastConnectTimeout", milliseconds { 3000 } };
+        // Reuse the IP address leased last time instead of asking DHCP again
+        Property<bool> reuseIpLease { this, "reuseIpLease", false };
+        // Ask DHCP again once the reused lease is this old; keep it well below the lease time of the DHCP server
+        Property<seconds> ipLeaseMaxAge { this, "ipLeaseMaxAge", hours { 1 } };
+    };
+
+    /**
+     * @brief How long it took to connect, and how.
+     */
+    struct Metrics {
+        void populate(JsonObject json) const {
+            json["fastConnects"] = fastConnects;
+            json["fastConnectFailures"] = fastConnectFailures;
+            json["fullConnects"] = fullConnects;
+            json["lastConnectUs"] = lastConnectTime.count();
+            json["lastConnectFast"] = lastConnectFast;
+        }
+
+        unsigned long fastConnects = 0;
+        unsigned long fastConnectFailures = 0;
+        unsigned long fullConnects = 0;
+        microseconds lastConnectTime = microseconds::zero();
+        bool lastConnectFast = false;
+    };
+
+    virtual void begin(const String& hostname, const Config& config) = 0;
 
     /**
      * Reset stored configuration.
      */
     virtual void resetSettings() = 0;
+
+    const Metrics& getMetrics() const {
+        return metrics;
+    }
+
+protected:
+    Metrics metrics;
 };
 
 }}    // namespace farmhub::client
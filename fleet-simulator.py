@@ -0,0 +1,420 @@
+#!/usr/bin/env python3
+"""
+Backend load generator: runs many virtual ugly-duckling devices in a single process against an MQTT broker.
+
+This only loads the backend. It does not run the firmware, and does not tell how much CPU
+a device would spend; see `MqttFleetTest` in the ugly-duckling native tests for that.
+
+Each virtual device speaks the same MQTT protocol as the firmware:
+
+ - publishes `init` on start,
+ - subscribes to the retained `config` topic and to `commands/#`,
+ - publishes telemetry on the `telemetry`, `telemetry/flow` and `telemetry/environment`
+   channels at its own heartbeat (taken from `config` if present),
+ - publishes `events/valve/state` when its synthetic valve opens or closes,
+ - answers the `ping`, `echo` and `override` commands under `responses/...`.
+
+Valve and flow behavior is synthetic: valves follow the configured schedules
+(or manual overrides), and water flows while the valve is open.
+
+Usage:
+
+    pip install paho-mqtt
+    ./fleet-simulator.py --host localhost --devices 500 --duration 300
+
+At every report interval the simulator prints the aggregate publish and receive rates.
+
+The protocol is reimplemented here rather than taken from the firmware. To catch
+the two drifting apart, the topics and commands the simulator knows about are
+checked against the firmware sources on start; run with `--check-protocol` to
+only do the check, e.g. in CI.
+"""
+
+import argparse
+import heapq
+import json
+import os
+import random
+import re
+import sys
+import threading
+import time
+from datetime import datetime, timezone
+
+import paho.mqtt.client as mqtt
+
+APP = "ugly-duckling"
+VERSION = "simulated"
+
+# The parts of the firmware protocol the virtual devices implement
+PUBLISHED_TOPICS = {"init", "sleep", "telemetry", "telemetry/flow", "telemetry/environment", "events/valve/state"}
+HANDLED_COMMANDS = {"ping", "echo", "override"}
+
+# Parts of the firmware protocol deliberately left out of the simulation
+IGNORED_TOPICS = {
+    # Only published after wakes without the network, which the virtual devices don't have
+    "telemetry/batch",
+}
+IGNORED_COMMANDS = {
+    "reset-wifi", "wifi/metrics", "restart", "update",
+    "files/list", "files/read", "files/write", "files/remove",
+    "mqtt/metrics", "config/schema", "telemetry/metrics", "telemetry/query",
+}
+
+FIRMWARE_SOURCES = ["farmhub-client/src", "ugly-duckling/src"]
+
+
+def scan_firmware_protocol(root):
+    """Collects the topics the firmware publishes to and the commands it registers from its sources."""
+    topics = set()
+    commands = set()
+    for source in FIRMWARE_SOURCES:
+        for directory, _, files in os.walk(os.path.join(root, source)):
+            for name in files:
+                if not name.endswith((".hpp", ".cpp")):
+                    continue
+                with open(os.path.join(directory, name)) as file:
+                    code = file.read()
+                commands.update(re.findall(r'registerCommand\(\s*"([^"]+)"', code))
+                # Only whole topics, not prefixes like "events/" + event
+                topics.update(re.findall(r'\bpublish\(\s*"([^"]+)"\s*,', code))
+                topics.update("events/" + event for event in re.findall(r'publishEvent\(\s*"([^"]+)"', code))
+                # Telemetry channels are given their topics when constructed
+                topics.update(re.findall(r'"(telemetry(?:/[a-z]+)*)"', code))
+    # Commands like telemetry/query look like telemetry topics
+    return topics - commands, commands
+
+
+def check_protocol(root):
+    """Returns the differences between the protocol of the firmware and that of the simulator."""
+    topics, commands = scan_firmware_protocol(root)
+    problems = []
+    for topic in sorted(topics - PUBLISHED_TOPICS - IGNORED_TOPICS):
+        problems.append("firmware publishes to '%s', the simulator does not" % topic)
+    for topic in sorted(PUBLISHED_TOPICS - topics):
+        problems.append("simulator publishes to '%s', the firmware does not" % topic)
+    for command in sorted(commands - HANDLED_COMMANDS - IGNORED_COMMANDS):
+        problems.append("firmware handles command '%s', the simulator does not" % command)
+    for command in sorted(HANDLED_COMMANDS - commands):
+        problems.append("simulator handles command '%s', the firmware does not" % command)
+    return problems
+
+
+def create_client(client_id):
+    # Support both paho-mqtt 1.x and 2.x
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        return mqtt.Client(mqtt.CallbackAPIVersion.VERSION1, client_id=client_id, clean_session=True)
+    return mqtt.Client(client_id=client_id, clean_session=True)
+
+
+def parse_iso_date(value):
+    return datetime.strptime(value, "%Y-%m-%dT%H:%M:%SZ").replace(tzinfo=timezone.utc).timestamp()
+
+
+def sample_window(sample, count=4):
+    """Aggregates a few samples the same way sampled telemetry providers do."""
+    samples = [round(sample(), 2) for _ in range(count)]
+    return {
+        "min": min(samples),
+        "max": max(samples),
+        "mean": round(sum(samples) / count, 2),
+        "last": samples[-1],
+        "count": count,
+    }
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.published = 0
+        self.received = 0
+        self.failed = 0
+
+    def count_published(self, success):
+        with self.lock:
+            if success:
+                self.published += 1
+            else:
+                self.failed += 1
+
+    def count_received(self):
+        with self.lock:
+            self.received += 1
+
+    def snapshot(self):
+        with self.lock:
+            return self.published, self.received, self.failed
+
+
+class VirtualDevice:
+    def __init__(self, index, args, stats):
+        self.instance = "%s-%04d" % (args.instance_prefix, index)
+        self.topic = "devices/%s/%s" % (APP, self.instance)
+        self.model = args.model
+        self.stats = stats
+        self.started = time.monotonic()
+
+        # Spread heartbeats so devices don't publish in lock-step
+        self.heartbeat = args.heartbeat * random.uniform(1 - args.jitter, 1 + args.jitter)
+        self.schedules = []
+        self.override_state = None
+        self.override_end = 0.0
+
+        self.valve_open = False
+        self.flow_rate = random.uniform(args.min_flow, args.max_flow)
+        self.volume = 0.0
+        self.last_measured = time.monotonic()
+        self.last_published = self.last_measured
+
+        # Commands arrive on the MQTT network thread, telemetry is driven by the main thread
+        self.lock = threading.RLock()
+
+        self.client = create_client("%s-%s" % (APP, self.instance))
+        self.client.on_connect = self.on_connect
+        self.client.on_message = self.on_message
+
+    def uptime_millis(self):
+        return int((time.monotonic() - self.started) * 1000)
+
+    @staticmethod
+    def timestamp_millis():
+        return int(time.time() * 1000)
+
+    def start(self, host, port):
+        self.client.connect_async(host, port, keepalive=180)
+        self.client.loop_start()
+
+    def stop(self):
+        result = self.publish("sleep", {"duration": 0})
+        # The network loop has to run until the message is out
+        if result.rc == mqtt.MQTT_ERR_SUCCESS:
+            result.wait_for_publish(timeout=5)
+        self.client.loop_stop()
+        self.client.disconnect()
+
+    def publish(self, suffix, payload, retain=False, qos=0):
+        result = self.client.publish(self.topic + "/" + suffix, json.dumps(payload), qos=qos, retain=retain)
+        self.stats.count_published(result.rc == mqtt.MQTT_ERR_SUCCESS)
+        return result
+
+    def on_connect(self, client, userdata, flags, rc):
+        if rc != 0:
+            print("%s: failed to connect, rc = %d" % (self.instance, rc))
+            return
+        client.subscribe(self.topic + "/config", qos=2)
+        client.subscribe(self.topic + "/commands/#", qos=2)
+        self.publish("init", {
+            "type": APP,
+            "model": self.model,
+            "instance": self.instance,
+            "mac": "sim:" + self.instance,
+            "deviceConfig": {},
+            "app": APP,
+            "version": VERSION,
+            "wakeup": 0,
+            "timestamp": self.timestamp_millis(),
+        })
+
+    def on_message(self, client, userdata, message):
+        self.stats.count_received()
+        try:
+            payload = json.loads(message.payload) if message.payload else None
+        except ValueError:
+            payload = None
+        suffix = message.topic[len(self.topic) + 1:]
+        with self.lock:
+            if suffix == "config":
+                self.update_config(payload or {})
+            elif suffix.startswith("commands/"):
+                if payload is None:
+                    # Ignore empty payload we've sent to clear the command
+                    return
+                command = suffix[len("commands/"):]
+                # Clear command topic
+                client.publish(message.topic, "", qos=0, retain=True)
+                response = self.handle_command(command, payload)
+                if response:
+                    self.publish("responses/" + command, response, qos=2)
+
+    def update_config(self, config):
+        if "heartbeat" in config:
+            self.heartbeat = float(config["heartbeat"])
+        self.schedules = []
+        for schedule in config.get("schedule") or []:
+            try:
+                self.schedules.append((
+                    parse_iso_date(schedule["start"]),
+                    int(schedule["period"]),
+                    int(schedule["duration"]),
+                ))
+            except (KeyError, ValueError):
+                print("%s: ignoring invalid schedule %s" % (self.instance, schedule))
+
+    def handle_command(self, command, request):
+        if command == "ping":
+            self.publish_telemetry()
+            return {"pong": self.uptime_millis()}
+        if command == "echo":
+            return {"original": request}
+        if command == "override":
+            state = int(request.get("state", 0))
+            if state == 0:
+                self.override_state = None
+                return {"state": 1 if self.valve_open else -1}
+            duration = int(request.get("duration", 3600))
+            self.override_state = state
+            self.override_end = time.time() + duration
+            self.update_valve()
+            return {"duration": duration, "state": state}
+        return None
+
+    def is_scheduled(self, now):
+        for start, period, duration in self.schedules:
+            if now >= start and period > 0 and (now - start) % period < duration:
+                return True
+        return False
+
+    def update_valve(self):
+        now = time.time()
+        if self.override_state is not None and now >= self.override_end:
+            self.override_state = None
+        if self.override_state is not None:
+            target = self.override_state == 1
+        elif self.schedules:
+            target = self.is_scheduled(now)
+        else:
+            target = self.valve_open
+        if target != self.valve_open:
+            self.measure()
+            self.valve_open = target
+            self.publish("events/valve/state", {"state": 1 if target else -1, "timestamp": self.timestamp_millis()})
+            self.publish_telemetry()
+
+    def measure(self):
+        now = time.monotonic()
+        if self.valve_open:
+            self.volume += self.flow_rate * random.uniform(0.9, 1.1) * (now - self.last_measured) / 60.0
+        self.last_measured = now
+
+    def publish_telemetry(self):
+        self.measure()
+        uptime = self.uptime_millis()
+        timestamp = self.timestamp_millis()
+        self.publish("telemetry", {
+            "uptime": uptime,
+            "timestamp": timestamp,
+            "valve": 1 if self.valve_open else -1,
+            "battery": random.randint(3000, 3300),
+        }, qos=1)
+
+        flow = {
+            "uptime": uptime,
+            "timestamp": timestamp,
+            "volume": self.volume,
+        }
+        elapsed = self.last_measured - self.last_published
+        if elapsed > 0:
+            flow["flowRate"] = self.volume / elapsed * 60
+        self.volume = 0.0
+        self.last_published = self.last_measured
+        self.publish("telemetry/flow", flow, qos=1)
+
+        self.publish("telemetry/environment", {
+            "uptime": uptime,
+            "timestamp": timestamp,
+            "temperature": sample_window(lambda: random.gauss(22, 2)),
+            "humidity": sample_window(lambda: random.uniform(40, 60)),
+            "soilTemperature": sample_window(lambda: random.gauss(16, 1)),
+            "soilMoisture": sample_window(lambda: random.uniform(20, 60)),
+        }, qos=1)
+
+
+def run(args):
+    stats = Stats()
+    devices = [VirtualDevice(index, args, stats) for index in range(args.devices)]
+
+    print("Starting %d virtual devices against %s:%d" % (len(devices), args.host, args.port))
+    for device in devices:
+        device.start(args.host, args.port)
+        if args.ramp_up > 0:
+            time.sleep(args.ramp_up / len(devices))
+
+    # Schedule of (next deadline, device index, kind)
+    start = time.monotonic()
+    queue = []
+    for index, device in enumerate(devices):
+        heapq.heappush(queue, (start + random.uniform(0, device.heartbeat), index, "telemetry"))
+        heapq.heappush(queue, (start + 1, index, "valve"))
+
+    last_report = start
+    last_published, last_received, _ = stats.snapshot()
+    end = start + args.duration if args.duration > 0 else float("inf")
+    try:
+        while True:
+            now = time.monotonic()
+            if now >= end:
+                break
+            while queue and queue[0][0] <= now:
+                _, index, kind = heapq.heappop(queue)
+                device = devices[index]
+                with device.lock:
+                    if kind == "telemetry":
+                        device.publish_telemetry()
+                        heapq.heappush(queue, (now + device.heartbeat, index, kind))
+                    else:
+                        device.update_valve()
+                        heapq.heappush(queue, (now + 1, index, kind))
+
+            if now - last_report >= args.report_interval:
+                published, received, failed = stats.snapshot()
+                elapsed = now - last_report
+                print("%7.1fs: %8.1f msg/s published, %8.1f msg/s received, %d failed"
+                    % (now - start,
+                        (published - last_published) / elapsed,
+                        (received - last_received) / elapsed,
+                        failed))
+                last_report = now
+                last_published, last_received = published, received
+
+            next_deadline = min(queue[0][0] if queue else now + 1, last_report + args.report_interval, end)
+            time.sleep(max(0.0, min(next_deadline - time.monotonic(), 0.1)))
+    except KeyboardInterrupt:
+        pass
+
+    for device in devices:
+        device.stop()
+
+    published, received, failed = stats.snapshot()
+    elapsed = time.monotonic() - start
+    print("Simulated %d devices for %.1f s: %d messages published (%.1f msg/s), %d received, %d failed"
+        % (len(devices), elapsed, published, published / elapsed, received, failed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate a fleet of FarmHub devices against an MQTT broker")
+    parser.add_argument("--host", default="localhost", help="MQTT broker host")
+    parser.add_argument("--port", type=int, default=1883, help="MQTT broker port")
+    parser.add_argument("--devices", type=int, default=100, help="number of virtual devices")
+    parser.add_argument("--duration", type=float, default=0, help="seconds to run, 0 to run until interrupted")
+    parser.add_argument("--heartbeat", type=float, default=60, help="default telemetry interval in seconds")
+    parser.add_argument("--jitter", type=float, default=0.1, help="relative variation of the heartbeat between devices")
+    parser.add_argument("--ramp-up", type=float, default=10, help="seconds to spread device connections over")
+    parser.add_argument("--report-interval", type=float, default=10, help="seconds between statistics reports")
+    parser.add_argument("--instance-prefix", default="sim", help="prefix of the virtual device instance names")
+    parser.add_argument("--model", default="mk5", help="hardware model to report")
+    parser.add_argument("--min-flow", type=float, default=5, help="minimum flow rate of open valves in l/min")
+    parser.add_argument("--max-flow", type=float, default=20, help="maximum flow rate of open valves in l/min")
+    parser.add_argument("--check-protocol", action="store_true", help="only check the simulated protocol against the firmware sources")
+    args = parser.parse_args()
+
+    root = os.path.dirname(os.path.abspath(__file__))
+    problems = check_protocol(root)
+    for problem in problems:
+        print("Protocol mismatch: " + problem, file=sys.stderr)
+    if args.check_protocol:
+        sys.exit(1 if problems else 0)
+    run(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -4,16 +4,21 @@
 
 using namespace farmhub::client;
 
-class AbstractEnvironmentHandler : public TelemetryProvider {
+class AbstractEnvironmentHandler : public SampledTelemetryProvider {
+public:
+    AbstractEnvironmentHandler(TaskContainer& tasks, const String& name, std::function<microseconds()> samplingInterval)
+        : SampledTelemetryProvider(tasks, name, samplingInterval) {
+    }
+
 protected:
-    void populateTelemetry(JsonObject& json) override {
+    void sample() override {
         if (!enabled) {
             return;
         }
-        populateTelemetryInternal(json);
+        sampleInternal();
     }
 
-    virtual void populateTelemetryInternal(JsonObject& json);
+    virtual void sampleInternal() = 0;
 
     bool enabled = false;
 };
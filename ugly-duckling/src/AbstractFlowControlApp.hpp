@@ -4,14 +4,30 @@
 
 #include <Application.hpp>
 #include <Ntp.hpp>
+#include <RtcMessageBuffer.hpp>
+#include <RtcRecord.hpp>
+#include <WakePlanner.hpp>
+#include <WallClock.hpp>
 #include <wifi/WiFiManagerProvider.hpp>
 
 #include "MeterHandler.hpp"
+#include "TelemetryBatchPolicy.hpp"
 #include "ValveHandler.hpp"
 #include "version.h"
 
 using namespace farmhub::client;
 
+using TelemetryBatchRtcRecord = RtcRecord<TelemetryBatchRtcState, 16>;
+
+RTC_DATA_ATTR
+TelemetryBatchRtcRecord::Slot telemetryBatchRtcSlot;
+
+// Telemetry sampled during wakes without the network, as MessagePack
+using TelemetryBatch = RtcMessageBuffer<4096>;
+
+RTC_DATA_ATTR
+TelemetryBatch::Slot telemetryBatchSlot;
+
 class AbstractFlowControlDeviceConfig : public Application::DeviceConfiguration {
 public:
     AbstractFlowControlDeviceConfig(const String& defaultModel)
@@ -28,11 +44,17 @@ public:
 class FlowControlAppConfig : public Application::AppConfiguration {
 public:
     FlowControlAppConfig()
-        : Application::AppConfiguration() {
+        : Application::AppConfiguration(minutes { 1 }, minutes { 15 }) {
     }
 
     MeterHandler::Config meter { this };
+    // Maximum time to sleep, the device wakes earlier for valve transitions and environment telemetry
     Property<seconds> sleepPeriod { this, "sleepPeriod", seconds::zero() };
+    // Only start the network at every Nth timer wake, and buffer telemetry in RTC memory in between
+    Property<int> uploadEvery { this, "uploadEvery", 1 };
+    Property<seconds> samplingInterval { this, "samplingInterval", seconds { 15 } };
+    Property<seconds> flowTelemetryInterval { this, "flowTelemetryInterval", seconds { 5 } };
+    Property<seconds> environmentTelemetryInterval { this, "environmentTelemetryInterval", minutes { 15 } };
     RawJsonEntry schedule { this, "schedule" };
 };
 
@@ -84,42 +106,240 @@ public:
         : Application("ugly-duckling", VERSION, deviceConfig, config, wifiProvider)
         , deviceConfig(deviceConfig)
         , valve(tasks, mqtt, events, valveController) {
-        telemetryPublisher.registerProvider(flowMeter);
-        telemetryPublisher.registerProvider(valve);
-        config.onUpdate([&]() {
-            valve.setSchedule(config.schedule.get());
+        telemetryPublisher.registerProvider(valve, "valve");
+        telemetryPublisher.recordTo(timeSeries);
+        telemetryPublisher.setDeadband("battery", 50);
+
+        telemetryMetricsCommand.addPublisher(flowTelemetry);
+        flowTelemetry.registerProvider(flowMeter, "flowMeter");
+        flowTelemetry.recordTo(timeSeries);
+        flowTelemetry.setMaxSilence(config.maxSilence);
+        flowTelemetry.setAccumulated("volume");
+        flowTelemetry.setDeadband("flowRate", 0.5);
+
+        telemetryMetricsCommand.addPublisher(environmentTelemetry);
+        environmentTelemetry.setMaxSilence(config.maxSilence);
+        environmentTelemetry.recordTo(timeSeries);
+        environmentTelemetry.setDeadband("temperature", 0.5);
+        environmentTelemetry.setDeadband("humidity", 2);
+        environmentTelemetry.setDeadband("soilTemperature", 0.5);
+        environmentTelemetry.setDeadband("soilMoisture", 2);
+
+        config.schedule.onChange([&](JsonVariant schedule) {
+            valve.setSchedule(schedule);
+        });
+
+        wakePlanner.require("valve", [&]() {
+            return valve.timeUntilNextTransition();
+        });
+        wakePlanner.require("environment telemetry", [&]() {
+            int64_t now = 0;
+            bool clockSynchronized = WallClock::toUtcMillis(boot_clock::now(), now);
+            return TelemetryBatchPolicy::timeUntilEnvironmentDue(environmentTelemetry.timeUntilNextRun(), batchState,
+                power.scale(config.environmentTelemetryInterval.get()), clockSynchronized, now);
         });
     }
 
 protected:
+    void beginOffline() override {
+        telemetryBatch.begin();
+        if (!batchRtcState.restore(batchState)) {
+            batchState = { 0, false, 0 };
+        }
+        auto reason = TelemetryBatchPolicy::reasonToGoOnline(batchState,
+            {
+                esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER,
+                config.sleepPeriod.get() > seconds::zero(),
+                config.uploadEvery.get(),
+                telemetryBatch.getUsed(),
+                telemetryBatch.getCapacity(),
+                WallClock::isSynchronized(),
+            });
+        if (reason != nullptr) {
+            Serial.printf("Starting network: %s\n", reason);
+            return;
+        }
+
+        Serial.printf("Sampling telemetry without network, wake %d of %d\n",
+            batchState.wakesSinceUpload + 1, config.uploadEvery.get());
+        beginDevices();
+        devicesStarted = true;
+        // The battery level is known now
+        power.update();
+        valve.restoreState();
+        bufferTelemetry();
+        batchState.wakesSinceUpload++;
+        onSleep();
+
+        // The valve needs to change state soon, carry on with the network
+        batchRtcState.save(batchState);
+    }
+
     void beginApp() override {
         ntp.begin();
 
+        if (!devicesStarted) {
+            beginDevices();
+        }
+
+        valve.begin();
+
+        uploadTelemetryBatch();
+    }
+
+    virtual void beginPeripherials() = 0;
+
+    /**
+     * @brief Registers a sensor whose telemetry is published on the environment channel, and is buffered during wakes without the network.
+     */
+    void registerEnvironmentSensor(SampledTelemetryProvider& sensor, const String& name) {
+        // Sampled providers reset their windows when populating telemetry, so they must not have a budget
+        environmentTelemetry.registerProvider(sensor, name);
+        environmentSensors.push_back(&sensor);
+    }
+
+private:
+    void beginDevices() {
         led.begin(deviceConfig.getLedPin(), deviceConfig.getLedEnabledState());
         flowMeter.begin(deviceConfig.getFlowMeterPin());
 
         beginPeripherials();
+    }
 
-        valve.begin();
+    void bufferTelemetry() {
+        int64_t timestamp;
+        if (!WallClock::toUtcMillis(boot_clock::now(), timestamp)) {
+            Serial.println("Clock not set, not buffering telemetry");
+            return;
+        }
+
+        for (auto sensor : environmentSensors) {
+            sensor->sampleNow();
+        }
+
+        DynamicJsonDocument doc(2048);
+        JsonObject record = doc.to<JsonObject>();
+        record["timestamp"] = timestamp;
+        telemetryPublisher.collect(record);
+        // Report the volume measured since the last wake with this wake, not the next online one
+        flowTelemetry.collect(record);
+        environmentTelemetry.collect(record);
+        batchState.environmentSampledAt = timestamp;
+        timeSeries.record(record, timestamp / 1000);
+
+        uint8_t buffer[512];
+        if (measureMsgPack(doc) > sizeof(buffer)) {
+            Serial.println("Telemetry record is too large to buffer");
+            return;
+        }
+        size_t length = serializeMsgPack(doc, buffer, sizeof(buffer));
+        if (!telemetryBatch.append(buffer, length)) {
+            Serial.println("Telemetry batch is full, dropping record");
+            return;
+        }
+        Serial.printf("Buffered %d bytes of telemetry, %d records in %d bytes\n",
+            length, telemetryBatch.getCount(), telemetryBatch.getUsed());
     }
 
-    virtual void beginPeripherials() = 0;
+    /**
+     * @brief Publishes the telemetry buffered during wakes without the network to <code>telemetry/batch</code>.
+     *
+     * Records are split between messages so that each fits in the MQTT buffer. The batch is kept in RTC memory
+     * until the broker has acknowledged every message, so that it is uploaded again after a failed attempt.
+     */
+    void uploadTelemetryBatch() {
+        if (telemetryBatch.getCount() == 0) {
+            batchState = { 0, false, batchState.environmentSampledAt };
+            batchRtcState.save(batchState);
+            return;
+        }
+
+        Serial.printf("Uploading %d telemetry records buffered during sleep\n", telemetryBatch.getCount());
+        DynamicJsonDocument doc(4 * MQTT_BUFFER_SIZE);
+        JsonArray records = doc.createNestedArray("records");
+        DynamicJsonDocument record(2048);
+        telemetryBatch.forEach([&](const uint8_t* message, size_t length) {
+            if (deserializeMsgPack(record, message, length)) {
+                Serial.println("Skipping invalid telemetry record");
+                return;
+            }
+            // Leave room for the separator and the timestamp added when sending
+            if (records.size() > 0 && measureJson(doc) + measureJson(record) + 32 > MQTT_BUFFER_SIZE) {
+                publishTelemetryBatch(doc);
+                doc.clear();
+                records = doc.createNestedArray("records");
+            }
+            records.add(record.as<JsonObject>());
+        });
+        if (records.size() > 0) {
+            publishTelemetryBatch(doc);
+        }
+    }
+
+    void publishTelemetryBatch(const JsonDocument& doc) {
+        pendingBatchMessages++;
+        mqtt.publish("telemetry/batch", doc, MqttHandler::Retention::NoRetain, MqttHandler::QoS::AtLeastOnce, MqttHandler::Timestamp::Omit, [&]() {
+            if (--pendingBatchMessages > 0) {
+                return;
+            }
+            Serial.println("Telemetry batch uploaded");
+            telemetryBatch.clear();
+            batchState = { 0, false, batchState.environmentSampledAt };
+            batchRtcState.save(batchState);
+        });
+    }
 
-private:
     void onSleep() {
-        if (config.sleepPeriod.get() > seconds::zero()) {
-            sleep.deepSleepFor(config.sleepPeriod.get());
+        if (config.sleepPeriod.get() <= seconds::zero()) {
+            return;
+        }
+        auto plan = wakePlanner.plan(config.sleepPeriod.get(), MIN_SLEEP_PERIOD);
+        if (plan.duration == microseconds::zero()) {
+            Serial.printf("Staying awake for %s\n", plan.reason);
+            return;
         }
+        if (plan.reason != nullptr) {
+            Serial.printf("Waking up early for %s\n", plan.reason);
+        }
+        // Start the network after the valve has changed state, so that the change gets reported
+        batchState.urgentWake = valve.timeUntilNextTransition() <= plan.duration;
+        batchRtcState.save(batchState);
+        sleep.deepSleepFor(plan.duration);
     }
 
+    // Waking up costs more than staying awake for less than this
+    const seconds MIN_SLEEP_PERIOD { 30 };
+
     AbstractFlowControlDeviceConfig& deviceConfig;
+
+protected:
     FlowControlAppConfig config;
 
+private:
     NtpHandler ntp { tasks, mdns };
+    WakePlanner wakePlanner;
+    std::list<SampledTelemetryProvider*> environmentSensors;
+    TelemetryBatch telemetryBatch { telemetryBatchSlot, 1 };
+    TelemetryBatchRtcRecord batchRtcState { telemetryBatchRtcSlot, 2 };
+    TelemetryBatchRtcState batchState { 0, false, 0 };
+    // Messages of the batch upload the broker has yet to acknowledge
+    int pendingBatchMessages = 0;
+    // Whether the devices were already started in beginOffline()
+    bool devicesStarted = false;
     MeterHandler flowMeter { tasks, sleep, config.meter, std::bind(&AbstractFlowControlApp::onSleep, this) };
 
 protected:
     NonBlockingWiFiManagerProvider wifiProvider { tasks };
     LedHandler led { sleep };
     ValveHandler valve;
+
+    // Publish flow often while the valve is open, otherwise at the heartbeat like the rest
+    TelemetryPublisher flowTelemetry { tasks, mqtt,
+        [&]() -> microseconds {
+            return valve.getState() == ValveState::OPEN
+                ? duration_cast<microseconds>(config.flowTelemetryInterval.get())
+                : power.scale(config.heartbeat.get());
+        },
+        "telemetry/flow" };
+    TelemetryPublisher environmentTelemetry { tasks, mqtt, power.scaled(config.environmentTelemetryInterval), "telemetry/environment" };
 };
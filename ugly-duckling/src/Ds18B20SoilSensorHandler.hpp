@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <list>
+#include <vector>
+
 #include <DallasTemperature.h>
 #include <OneWire.h>
 
@@ -7,11 +11,20 @@
 
 using namespace farmhub::client;
 
+/**
+ * @brief Measures soil temperature with one or more DS18B20 probes, and soil moisture with an analog sensor.
+ *
+ * Temperature conversion takes up to 750 ms, so it is started ahead of sampling in non-blocking mode,
+ * and all probes on the bus convert in parallel. The first probe is reported as <code>soilTemperature</code>,
+ * additional probes as <code>soilTemperature2</code>, <code>soilTemperature3</code> etc.
+ */
 class Ds18B20SoilSensorHandler
     : public AbstractEnvironmentHandler {
 
 public:
-    Ds18B20SoilSensorHandler() = default;
+    Ds18B20SoilSensorHandler(TaskContainer& tasks, std::function<microseconds()> samplingInterval)
+        : AbstractEnvironmentHandler(tasks, "Sample soil sensor", samplingInterval) {
+    }
 
     void begin(gpio_num_t temperaturePin, gpio_num_t moisturePin) {
         Serial.printf("Initializing DS18B20 soil temperature sensor on pin %d\n", temperaturePin);
@@ -32,17 +45,33 @@ public:
             Serial.println("OFF");
         }
 
-        DeviceAddress thermometer;
-        if (!sensors.getAddress(thermometer, 0)) {
-            Serial.println("Unable to find address for device");
+        for (uint8_t index = 0; index < sensors.getDeviceCount(); index++) {
+            Address address;
+            if (!sensors.getAddress(address.data(), index)) {
+                Serial.printf("Unable to find address for device %d\n", index);
+                continue;
+            }
+
+            // show the addresses we found on the bus
+            Serial.printf("Device %d Address: ", index);
+            printAddress(address.data());
+            Serial.println();
+
+            String name = probes.empty()
+                ? "soilTemperature"
+                : "soilTemperature" + String(probes.size() + 1);
+            probes.push_back(address);
+            probeFields.emplace_back(this, name);
+        }
+        if (probes.empty()) {
+            Serial.println("Unable to find any DS18B20 device");
             enabled = false;
             return;
         }
 
-        // show the addresses we found on the bus
-        Serial.print("Device 0 Address: ");
-        printAddress(thermometer);
-        Serial.println();
+        // Start conversions without waiting for them to finish
+        sensors.setWaitForConversion(false);
+        conversionTime = milliseconds { sensors.millisToWaitForConversion(sensors.getResolution()) };
 
         Serial.printf("Initializing soil moisture sensor on pin %d\n", moisturePin);
         this->moisturePin = moisturePin;
@@ -52,25 +81,41 @@ public:
     }
 
 protected:
-    void populateTelemetryInternal(JsonObject& json) override {
-        populateTemperature(json);
-        populateMoisture(json);
+    microseconds prepareSample() override {
+        if (!enabled) {
+            return microseconds::zero();
+        }
+        sensors.requestTemperatures();
+        conversionReadyAt = boot_clock::now() + conversionTime;
+        conversionPending = true;
+        return conversionTime;
+    }
+
+    void sampleInternal() override {
+        sampleTemperature();
+        sampleMoisture();
     }
 
-    void populateTemperature(JsonObject& json) {
-        if (!sensors.requestTemperaturesByIndex(0)) {
-            Serial.println("Failed to get temperature from DS18B20 sensor");
+    void sampleTemperature() {
+        // We might get sampled before the conversion is finished when telemetry is published early
+        if (!conversionPending || boot_clock::now() < conversionReadyAt) {
             return;
         }
-        float temperature = sensors.getTempCByIndex(0);
-        if (temperature == DEVICE_DISCONNECTED_C) {
-            Serial.println("Failed to get temperature from DS18B20 sensor");
-            return;
+        conversionPending = false;
+
+        auto field = probeFields.begin();
+        for (auto& address : probes) {
+            float temperature = sensors.getTempC(address.data());
+            if (temperature == DEVICE_DISCONNECTED_C) {
+                Serial.println("Failed to get temperature from DS18B20 sensor");
+            } else {
+                field->record(temperature);
+            }
+            field++;
         }
-        json["soilTemperature"] = temperature;
     }
 
-    void populateMoisture(JsonObject& json) {
+    void sampleMoisture() {
         uint16_t soilMoistureValue = analogRead(moisturePin);
         Serial.printf("Soil moisture value: %d\n", soilMoistureValue);
 
@@ -79,17 +124,28 @@ protected:
         const double delta = soilMoistureValue - AirValue;
         double moisture = (delta * rise) / run;
 
-        json["soilMoisture"] = moisture;
+        soilMoisture.record(moisture);
     }
 
 private:
+    typedef std::array<uint8_t, 8> Address;
+
     // Setup a oneWire instance to communicate with any OneWire devices (not just Maxim/Dallas temperature ICs)
     OneWire oneWire;
 
     // Pass our oneWire reference to Dallas Temperature.
     DallasTemperature sensors { &oneWire };
 
-    void printAddress(DeviceAddress deviceAddress) {
+    std::vector<Address> probes;
+    // Fields register themselves with the provider, so they must not move
+    std::list<Field> probeFields;
+    Field soilMoisture { this, "soilMoisture" };
+
+    milliseconds conversionTime;
+    time_point<boot_clock> conversionReadyAt;
+    bool conversionPending = false;
+
+    void printAddress(const uint8_t* deviceAddress) {
         for (uint8_t i = 0; i < 8; i++) {
             // zero pad the address if necessary
             if (deviceAddress[i] < 16)
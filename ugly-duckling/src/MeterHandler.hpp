@@ -3,12 +3,27 @@
 #include <chrono>
 #include <driver/pcnt.h>
 
+#include <RtcRecord.hpp>
 #include <Task.hpp>
 #include <Telemetry.hpp>
 
+#include "UlpFlowMeter.hpp"
+
 using namespace std::chrono;
 using namespace farmhub::client;
 
+struct MeterRtcState {
+    // Volume measured but not yet published
+    double volume;
+    // Whether the ULP has been counting pulses during deep sleep
+    bool ulpCounting;
+};
+
+using MeterRtcRecord = RtcRecord<MeterRtcState, 24>;
+
+RTC_DATA_ATTR
+MeterRtcRecord::Slot meterHandlerRtcSlot;
+
 class MeterHandler
     : public BaseTask,
       public BaseSleepListener,
@@ -24,6 +39,11 @@ public:
         Property<double> qFactor { this, "qFactor", 5.0 };
         Property<seconds> measurementFrequency { this, "measurementFrequency", seconds { 1 } };
         Property<seconds> noFlowTimeout { this, "noFlowTimeout", minutes { 10 } };
+        // When either of these are set, pulses are counted on the ULP during deep sleep instead of waking up at the first pulse
+        // Wake up after this many liters have flown, zero to disable
+        Property<double> wakeVolume { this, "wakeVolume", 0.0 };
+        // Wake up when the flow exceeds this many liters per minute, zero to disable
+        Property<double> wakeFlowRate { this, "wakeFlowRate", 0.0 };
     };
 
     MeterHandler(
@@ -38,6 +58,17 @@ public:
         this->flowPin = flowPin;
         Serial.printf("Initializing flow meter on pin %d with Q = %f\n", flowPin, config.qFactor.get());
 
+        MeterRtcState saved;
+        if (rtcState.restore(saved)) {
+            volume = saved.volume;
+            if (saved.ulpCounting) {
+                volume += UlpFlowMeter::stop(flowPin) / config.qFactor.get() / 60.0f;
+            }
+            Serial.printf("Restored %.2f l of unpublished volume from before sleep\n", volume);
+        }
+        // Only restore after deep sleep, not after a reset that happens while awake
+        rtcState.clear();
+
         pinMode(flowPin, INPUT);
 
         pcnt_config_t pcntFreqConfig = {};
@@ -95,8 +126,13 @@ protected:
     }
 
     void onDeepSleep(SleepEvent& event) override {
-        Serial.println("Wake up on flow");
-        esp_sleep_enable_ext0_wakeup(flowPin, digitalRead(flowPin) == LOW);
+        bool ulpCounting = (config.wakeVolume.get() > 0 || config.wakeFlowRate.get() > 0)
+            && startUlp();
+        if (!ulpCounting) {
+            Serial.println("Wake up on flow");
+            esp_sleep_enable_ext0_wakeup(flowPin, digitalRead(flowPin) == LOW);
+        }
+        rtcState.save({ volume, ulpCounting });
     }
 
     void populateTelemetry(JsonObject& json) override {
@@ -112,7 +148,25 @@ protected:
     }
 
 private:
+    bool startUlp() {
+        double pulsesPerLiter = config.qFactor.get() * 60;
+        uint16_t volumeThreshold = toUlpThreshold(config.wakeVolume.get() * pulsesPerLiter);
+        uint16_t rateThreshold = toUlpThreshold(config.wakeFlowRate.get() * pulsesPerLiter);
+        Serial.printf("Counting flow on the ULP, waking up after %d pulses, or %d pulses per minute\n",
+            volumeThreshold, rateThreshold);
+        return UlpFlowMeter::start(flowPin, volumeThreshold, rateThreshold, minutes { 1 });
+    }
+
+    // Thresholds are 16 bits wide on the ULP, and the maximum is practically never reached
+    static uint16_t toUlpThreshold(double pulses) {
+        if (pulses <= 0) {
+            return 0xFFFF;
+        }
+        return std::max(1.0, std::min(pulses, 65535.0));
+    }
+
     const Config& config;
+    MeterRtcRecord rtcState { meterHandlerRtcSlot, 2 };
     std::function<void()> onSleep;
     gpio_num_t flowPin;
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std::chrono;
+
+struct TelemetryBatchRtcState {
+    // Timer wakes since the buffered telemetry was last uploaded
+    uint16_t wakesSinceUpload;
+    // Whether the next wake needs the network, e.g. because the valve changes state
+    bool urgentWake;
+    // UTC milliseconds when the environment was last sampled without the network, zero if never
+    int64_t environmentSampledAt;
+};
+
+/**
+ * @brief Decides whether a wake can buffer telemetry without starting the network, and when the next sample is due.
+ */
+class TelemetryBatchPolicy {
+public:
+    struct Wake {
+        // Whether the wake was caused by the timer, as opposed to flow or a reset
+        bool timerWake;
+        bool sleepEnabled;
+        // Start the network every this many timer wakes
+        int uploadEvery;
+        size_t batchUsed;
+        size_t batchCapacity;
+        bool clockSynchronized;
+    };
+
+    /**
+     * @brief Returns why the network needs to be started, or <code>nullptr</code> if the wake can stay offline.
+     */
+    static const char* reasonToGoOnline(const TelemetryBatchRtcState& state, const Wake& wake) {
+        if (!wake.timerWake) {
+            return "wake not caused by timer";
+        }
+        if (!wake.sleepEnabled || wake.uploadEvery <= 1) {
+            return "batching disabled";
+        }
+        if (state.wakesSinceUpload + 1 >= wake.uploadEvery) {
+            return "upload due";
+        }
+        if (state.urgentWake) {
+            return "urgent wake";
+        }
+        if (wake.batchUsed > wake.batchCapacity * 3 / 4) {
+            return "telemetry batch nearly full";
+        }
+        // Buffered telemetry is useless without a timestamp
+        if (!wake.clockSynchronized) {
+            return "clock not set";
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Returns how long until the environment needs to be sampled again, zero if it was never sampled.
+     */
+    static microseconds timeUntilSampleDue(int64_t sampledAt, microseconds interval, int64_t now) {
+        if (sampledAt == 0) {
+            return microseconds::zero();
+        }
+        microseconds remaining = milliseconds { sampledAt - now } + interval;
+        return std::max(remaining, microseconds::zero());
+    }
+
+    /**
+     * @brief Returns how long the device can sleep before the environment telemetry is due.
+     *
+     * The telemetry task never runs on wakes without the network, so the sample buffered last is taken into account, too.
+     *
+     * @param untilTaskRun time until the environment telemetry task runs next.
+     * @param clockSynchronized whether <code>now</code> is known; if not, only the task is taken into account.
+     * @param now UTC milliseconds.
+     */
+    static microseconds timeUntilEnvironmentDue(microseconds untilTaskRun, const TelemetryBatchRtcState& state,
+        microseconds interval, bool clockSynchronized, int64_t now) {
+        if (!clockSynchronized) {
+            return untilTaskRun;
+        }
+        return std::max(untilTaskRun, timeUntilSampleDue(state.environmentSampledAt, interval, now));
+    }
+};
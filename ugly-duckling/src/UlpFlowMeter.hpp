@@ -0,0 +1,151 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/rtc_io.h>
+#include <esp_sleep.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/rtc_io_reg.h>
+
+#if CONFIG_IDF_TARGET_ESP32S2
+#include <esp32s2/ulp.h>
+#elif CONFIG_IDF_TARGET_ESP32S3
+#include <esp32s3/ulp.h>
+#else
+#include <esp32/ulp.h>
+#endif
+
+#include "UlpPulseCounter.hpp"
+
+// How often the ULP samples the flow pin; fast enough to see both halves of a 300 Hz signal
+#define ULP_FLOW_METER_SAMPLING_PERIOD_US 1000
+
+using namespace std::chrono;
+
+/**
+ * @brief Counts flow meter pulses on the ULP coprocessor while the main CPU is in deep sleep.
+ *
+ * The main CPU is only woken up once enough water has flown, or the flow rate is high enough,
+ * instead of at the first pulse. The counting logic is modelled by <code>UlpPulseCounterModel</code>.
+ */
+class UlpFlowMeter {
+public:
+    /**
+     * @brief Loads and starts the pulse counter program, returns false if the pin cannot be used by the ULP.
+     *
+     * @param volumeThreshold the number of pulses after which to wake the main CPU.
+     * @param rateThreshold the number of pulses within <code>window</code> after which to wake the main CPU.
+     */
+    static bool start(gpio_num_t pin, uint16_t volumeThreshold, uint16_t rateThreshold, milliseconds window) {
+        if (!rtc_gpio_is_valid_gpio(pin)) {
+            Serial.printf("Pin %d cannot be used by the ULP\n", pin);
+            return false;
+        }
+        int rtcPin = rtc_io_number_get(pin);
+
+        // Variables come first, the program after them
+        const ulp_insn_t program[] = {
+            I_MOVI(R3, 0),
+
+            // Start a new rate window when the current one is over
+            I_LD(R0, R3, ULP_WINDOW_TICKS_LEFT),
+            I_SUBI(R0, R0, 1),
+            I_ST(R0, R3, ULP_WINDOW_TICKS_LEFT),
+            M_BGE(LABEL_EDGE, 1),
+            I_LD(R0, R3, ULP_WINDOW_TICKS),
+            I_ST(R0, R3, ULP_WINDOW_TICKS_LEFT),
+            I_MOVI(R0, 0),
+            I_ST(R0, R3, ULP_WINDOW_PULSES),
+
+            // Count rising edges
+            M_LABEL(LABEL_EDGE),
+            I_RD_REG(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT_S + rtcPin, RTC_GPIO_IN_NEXT_S + rtcPin),
+            I_MOVR(R1, R0),
+            I_LD(R2, R3, ULP_LAST_LEVEL),
+            I_ST(R1, R3, ULP_LAST_LEVEL),
+            I_SUBR(R0, R1, R2),
+            // Unchanged
+            M_BL(LABEL_CHECK, 1),
+            // Falling edge
+            M_BGE(LABEL_CHECK, 2),
+            I_LD(R0, R3, ULP_PULSES),
+            I_ADDI(R0, R0, 1),
+            I_ST(R0, R3, ULP_PULSES),
+            I_LD(R0, R3, ULP_WINDOW_PULSES),
+            I_ADDI(R0, R0, 1),
+            I_ST(R0, R3, ULP_WINDOW_PULSES),
+
+            // Check thresholds; subtraction overflows when below threshold
+            M_LABEL(LABEL_CHECK),
+            I_LD(R1, R3, ULP_PULSES),
+            I_LD(R2, R3, ULP_VOLUME_THRESHOLD),
+            I_SUBR(R0, R1, R2),
+            M_BXF(LABEL_RATE),
+            M_BX(LABEL_WAKE),
+            M_LABEL(LABEL_RATE),
+            I_LD(R1, R3, ULP_WINDOW_PULSES),
+            I_LD(R2, R3, ULP_RATE_THRESHOLD),
+            I_SUBR(R0, R1, R2),
+            M_BXF(LABEL_HALT),
+
+            // Wake the main CPU if it's ready, otherwise try again at the next tick
+            M_LABEL(LABEL_WAKE),
+            I_RD_REG(RTC_CNTL_LOW_POWER_ST_REG, RTC_CNTL_RDY_FOR_WAKEUP_S, RTC_CNTL_RDY_FOR_WAKEUP_S),
+            M_BL(LABEL_HALT, 1),
+            I_WAKE(),
+
+            M_LABEL(LABEL_HALT),
+            I_HALT(),
+        };
+
+        rtc_gpio_init(pin);
+        rtc_gpio_set_direction(pin, RTC_GPIO_MODE_INPUT_ONLY);
+        rtc_gpio_hold_en(pin);
+
+        // Mirrors UlpPulseCounterModel::start()
+        uint16_t windowTicks = std::min<long long>(
+            duration_cast<microseconds>(window).count() / ULP_FLOW_METER_SAMPLING_PERIOD_US, 0xFFFF);
+        RTC_SLOW_MEM[ULP_LAST_LEVEL] = rtc_gpio_get_level(pin);
+        RTC_SLOW_MEM[ULP_PULSES] = 0;
+        RTC_SLOW_MEM[ULP_VOLUME_THRESHOLD] = volumeThreshold;
+        RTC_SLOW_MEM[ULP_WINDOW_PULSES] = 0;
+        RTC_SLOW_MEM[ULP_RATE_THRESHOLD] = rateThreshold;
+        RTC_SLOW_MEM[ULP_WINDOW_TICKS_LEFT] = windowTicks;
+        RTC_SLOW_MEM[ULP_WINDOW_TICKS] = windowTicks;
+
+        size_t size = sizeof(program) / sizeof(ulp_insn_t);
+        esp_err_t err = ulp_process_macros_and_load(ULP_PROGRAM_START, program, &size);
+        if (err != ESP_OK) {
+            Serial.printf("Failed to load ULP program: %d\n", err);
+            return false;
+        }
+        ulp_set_wakeup_period(0, ULP_FLOW_METER_SAMPLING_PERIOD_US);
+        err = ulp_run(ULP_PROGRAM_START);
+        if (err != ESP_OK) {
+            Serial.printf("Failed to start ULP program: %d\n", err);
+            return false;
+        }
+        esp_sleep_enable_ulp_wakeup();
+        return true;
+    }
+
+    /**
+     * @brief Stops the pulse counter program and returns the number of pulses it has counted.
+     */
+    static uint16_t stop(gpio_num_t pin) {
+        CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+        rtc_gpio_hold_dis(pin);
+        rtc_gpio_deinit(pin);
+        return RTC_SLOW_MEM[ULP_PULSES] & 0xFFFF;
+    }
+
+private:
+    static constexpr uint32_t ULP_PROGRAM_START = ULP_VARIABLE_COUNT;
+
+    enum {
+        LABEL_EDGE,
+        LABEL_CHECK,
+        LABEL_RATE,
+        LABEL_WAKE,
+        LABEL_HALT
+    };
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Words of RTC slow memory shared between the ULP pulse counter program and the main CPU.
+ *
+ * The ULP can only access the lower 16 bits of each word.
+ */
+enum UlpPulseCounterVariable {
+    // Level of the flow pin at the previous tick
+    ULP_LAST_LEVEL = 0,
+    // Rising edges counted since the program was started
+    ULP_PULSES,
+    // Wake the main CPU once this many pulses have been counted
+    ULP_VOLUME_THRESHOLD,
+    // Rising edges counted in the current rate window
+    ULP_WINDOW_PULSES,
+    // Wake the main CPU once this many pulses have been counted within a single window
+    ULP_RATE_THRESHOLD,
+    // Ticks remaining from the current rate window
+    ULP_WINDOW_TICKS_LEFT,
+    // Length of the rate window in ticks
+    ULP_WINDOW_TICKS,
+    ULP_VARIABLE_COUNT
+};
+
+/**
+ * @brief Host-side model of the ULP pulse counter program in <code>UlpFlowMeter</code>.
+ *
+ * Runs the same steps on the same 16-bit variables as the ULP program does at each tick,
+ * so that the counting and wake logic can be tested without hardware.
+ * Keep the two in sync.
+ */
+class UlpPulseCounterModel {
+public:
+    void start(uint16_t volumeThreshold, uint16_t rateThreshold, uint16_t windowTicks, bool level) {
+        memory[ULP_LAST_LEVEL] = level ? 1 : 0;
+        memory[ULP_PULSES] = 0;
+        memory[ULP_VOLUME_THRESHOLD] = volumeThreshold;
+        memory[ULP_WINDOW_PULSES] = 0;
+        memory[ULP_RATE_THRESHOLD] = rateThreshold;
+        memory[ULP_WINDOW_TICKS_LEFT] = windowTicks;
+        memory[ULP_WINDOW_TICKS] = windowTicks;
+    }
+
+    /**
+     * @brief Samples the flow pin once, returns true if the main CPU should be woken up.
+     */
+    bool tick(bool level) {
+        // Start a new rate window when the current one is over
+        memory[ULP_WINDOW_TICKS_LEFT]--;
+        if (memory[ULP_WINDOW_TICKS_LEFT] < 1) {
+            memory[ULP_WINDOW_TICKS_LEFT] = memory[ULP_WINDOW_TICKS];
+            memory[ULP_WINDOW_PULSES] = 0;
+        }
+
+        // Count rising edges
+        uint16_t current = level ? 1 : 0;
+        uint16_t difference = current - memory[ULP_LAST_LEVEL];
+        memory[ULP_LAST_LEVEL] = current;
+        if (difference == 1) {
+            memory[ULP_PULSES]++;
+            memory[ULP_WINDOW_PULSES]++;
+        }
+
+        return memory[ULP_PULSES] >= memory[ULP_VOLUME_THRESHOLD]
+            || memory[ULP_WINDOW_PULSES] >= memory[ULP_RATE_THRESHOLD];
+    }
+
+    uint16_t getPulses() const {
+        return memory[ULP_PULSES];
+    }
+
+private:
+    uint16_t memory[ULP_VARIABLE_COUNT] {};
+};
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <ClockMapping.hpp>
 #include <Events.hpp>
+#include <RtcRecord.hpp>
 #include <Task.hpp>
 #include <Telemetry.hpp>
 
@@ -9,8 +11,16 @@
 using namespace std::chrono;
 using namespace farmhub::client;
 
+struct ValveRtcState {
+    int8_t state;
+    // Seconds since the UNIX epoch, zero if there is no override
+    int64_t manualOverrideEnd;
+};
+
+using ValveRtcRecord = RtcRecord<ValveRtcState, 32>;
+
 RTC_DATA_ATTR
-int8_t valveHandlerStoredState;
+ValveRtcRecord::Slot valveHandlerRtcSlot;
 
 enum class ValveState {
     CLOSED = -1,
@@ -56,6 +66,29 @@ public:
         });
     }
 
+    ValveState getState() const {
+        return state;
+    }
+
+    /**
+     * @brief Returns how long until the valve needs to change state on its own, or <code>microseconds::max()</code> if never.
+     */
+    microseconds timeUntilNextTransition() {
+        auto now = system_clock::now();
+        time_point<system_clock> next;
+        if (manualOverrideEnd != time_point<system_clock>()) {
+            next = manualOverrideEnd;
+        } else if (!schedules.empty() && system_clock::to_time_t(now) >= CLOCK_MAPPING_VALID_UTC_MIN) {
+            next = scheduler.nextTransition(schedules, now);
+        } else {
+            return microseconds::max();
+        }
+        if (next == time_point<system_clock>::max()) {
+            return microseconds::max();
+        }
+        return std::max(duration_cast<microseconds>(next - now), microseconds::zero());
+    }
+
     void populateTelemetry(JsonObject& json) override {
         if (!enabled) {
             return;
@@ -73,19 +106,32 @@ public:
     void begin() {
         controller.reset();
 
-        // RTC memory is reset to 0 upon power-up
-        if (valveHandlerStoredState == 0) {
+        if (!restoreState()) {
             Serial.println("Initializing for the first time to default state");
             setState(controller.getDefaultState());
-        } else {
-            Serial.println("Initializing after waking from sleep with state = " + String(valveHandlerStoredState));
-            state = valveHandlerStoredState == 1
-                ? ValveState::OPEN
-                : ValveState::CLOSED;
         }
         enabled = true;
     }
 
+    /**
+     * @brief Restores the state kept across deep sleep without touching the valve, returns false if there is none.
+     */
+    bool restoreState() {
+        // RTC memory is reset to 0 upon power-up
+        ValveRtcState saved;
+        if (!rtcState.restore(saved)) {
+            return false;
+        }
+        Serial.println("Initializing after waking from sleep with state = " + String(saved.state));
+        state = saved.state == 1
+            ? ValveState::OPEN
+            : ValveState::CLOSED;
+        if (saved.manualOverrideEnd != 0) {
+            manualOverrideEnd = system_clock::from_time_t(saved.manualOverrideEnd);
+        }
+        return true;
+    }
+
     void setSchedule(const JsonArray schedulesJson) {
         schedules.clear();
         if (schedulesJson.isNull() || schedulesJson.size() == 0) {
@@ -111,6 +157,7 @@ public:
         Serial.println("Normal valve operation resumed");
         manualOverrideEnd = time_point<system_clock>();
         auto defaultState = controller.getDefaultState();
+        saveState();
     }
 
 protected:
@@ -152,21 +199,28 @@ private:
         switch (state) {
             case ValveState::OPEN:
                 Serial.println("Opening");
-                valveHandlerStoredState = 1;
                 controller.open();
                 break;
             case ValveState::CLOSED:
                 Serial.println("Closing");
-                valveHandlerStoredState = -1;
                 controller.close();
                 break;
         }
+        saveState();
         events.publishEvent("valve/state", [=](JsonObject& json) {
             json["state"] = state;
         });
     }
 
+    void saveState() {
+        rtcState.save({ static_cast<int8_t>(state),
+            manualOverrideEnd == time_point<system_clock>()
+                ? 0
+                : static_cast<int64_t>(system_clock::to_time_t(manualOverrideEnd)) });
+    }
+
     ValveScheduler scheduler;
+    ValveRtcRecord rtcState { valveHandlerRtcSlot, 1 };
     EventHandler& events;
     ValveController& controller;
 
@@ -74,4 +74,46 @@ public:
         }
         return false;
     }
+
+    /**
+     * @brief Returns the first time after <code>time</code> when the scheduled state changes,
+     * or <code>time_point::max()</code> if it never changes.
+     */
+    time_point<system_clock> nextTransition(const std::list<ValveSchedule>& schedules, time_point<system_clock> time) {
+        bool scheduled = isScheduled(schedules, time);
+        auto current = time;
+        // Overlapping schedules can hide each other's boundaries, so look a bit further ahead
+        for (int i = 0; i < 64; i++) {
+            auto next = time_point<system_clock>::max();
+            for (auto& schedule : schedules) {
+                next = std::min(next, nextBoundary(schedule, current));
+            }
+            if (next == time_point<system_clock>::max()) {
+                break;
+            }
+            if (isScheduled(schedules, next) != scheduled) {
+                return next;
+            }
+            current = next;
+        }
+        return time_point<system_clock>::max();
+    }
+
+private:
+    /**
+     * @brief Returns the first time after <code>time</code> when the schedule starts or ends.
+     */
+    static time_point<system_clock> nextBoundary(const ValveSchedule& schedule, time_point<system_clock> time) {
+        if (time < schedule.start) {
+            return schedule.start;
+        }
+        if (schedule.period <= seconds::zero() || schedule.duration >= schedule.period) {
+            // Never ends
+            return time_point<system_clock>::max();
+        }
+        auto offset = (time - schedule.start) % schedule.period;
+        return offset < schedule.duration
+            ? time - offset + schedule.duration
+            : time - offset + schedule.period;
+    }
 };
@@ -206,9 +206,12 @@ public:
     void stop() {
         digitalWrite(sleepPin, LOW);
         digitalWrite(enablePin, LOW);
+        pwmLock.release();
     }
 
     void drive(bool phase, double duty = 1) {
+        // The PWM is clocked from APB, which slows down with the CPU
+        pwmLock.acquire();
         digitalWrite(sleepPin, HIGH);
         digitalWrite(enablePin, HIGH);
 
@@ -236,6 +239,7 @@ private:
 
     const Config& config;
     ValveControlStrategy* strategy;
+    PowerLock pwmLock { "valve-pwm", ESP_PM_APB_FREQ_MAX };
 
     gpio_num_t enablePin;
     gpio_num_t phasePin;
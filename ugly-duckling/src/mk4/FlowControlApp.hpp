@@ -34,8 +34,8 @@ class FlowControlApp : public AbstractFlowControlApp {
 public:
     FlowControlApp()
         : AbstractFlowControlApp(deviceConfig, valveController) {
-        telemetryPublisher.registerProvider(builtInEnvironment);
-        telemetryPublisher.registerProvider(soilSensor);
+        registerEnvironmentSensor(builtInEnvironment, "builtInEnvironment");
+        registerEnvironmentSensor(soilSensor, "soilSensor");
     }
 
     void beginPeripherials() override {
@@ -55,8 +55,8 @@ public:
 
 private:
     FlowControlDeviceConfig deviceConfig;
-    Sht31Handler builtInEnvironment;
-    Ds18B20SoilSensorHandler soilSensor;
+    Sht31Handler builtInEnvironment { tasks, power.scaled(config.samplingInterval) };
+    Ds18B20SoilSensorHandler soilSensor { tasks, power.scaled(config.samplingInterval) };
     Drv8801ValveController valveController { deviceConfig.valve };
     HeldButtonListener resetWifi { tasks, "Reset WIFI", seconds { 5 },
         [&]() {
@@ -14,7 +14,9 @@ class Sht31Handler
     const int SHT31_ADDRESS = 0x44;
 
 public:
-    Sht31Handler() = default;
+    Sht31Handler(TaskContainer& tasks, std::function<microseconds()> samplingInterval)
+        : AbstractEnvironmentHandler(tasks, "Sample SHT31", samplingInterval) {
+    }
 
     void begin() {
         Serial.print("Initializing SHT31 sensor\n");
@@ -32,18 +34,18 @@ public:
     }
 
 protected:
-    void populateTelemetryInternal(JsonObject& json) override {
+    void sampleInternal() override {
         if (!sht.read()) {
             Serial.printf("SHT.read(): failed, error: %x\n", sht.getError());
             return;
         }
-        auto temperature = sht.getTemperature();
-        auto humidity = sht.getHumidity();
-        json["temperature"] = temperature;
-        json["humidity"] = humidity;
+        temperature.record(sht.getTemperature());
+        humidity.record(sht.getHumidity());
     }
 
 private:
+    Field temperature { this, "temperature" };
+    Field humidity { this, "humidity" };
 
     SHT31 sht;
 };
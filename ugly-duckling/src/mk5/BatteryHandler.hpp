@@ -15,11 +15,16 @@ public:
         pinMode(batteryPin, INPUT);
     }
 
+    /**
+     * @brief The raw battery reading, the same as reported in telemetry.
+     */
+    int getLevel() {
+        return analogRead(batteryPin);
+    }
+
 protected:
     void populateTelemetry(JsonObject& json) override {
-        // Volume is measured in liters
-        auto batteryLevel = analogRead(batteryPin);
-        json["battery"] = batteryLevel;
+        json["battery"] = getLevel();
     }
 
 private:
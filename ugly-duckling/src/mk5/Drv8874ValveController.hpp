@@ -202,9 +202,12 @@ public:
 
     void stop() {
         digitalWrite(sleepPin, LOW);
+        pwmLock.release();
     }
 
     void drive(bool phase, double duty = 1) {
+        // The PWM is clocked from APB, which slows down with the CPU
+        pwmLock.acquire();
         digitalWrite(sleepPin, HIGH);
 
         int dutyValue = PWM_MAX_VALUE / 2 + (int) (PWM_MAX_VALUE / 2 * duty);
@@ -232,6 +235,7 @@ private:
 
     const Config& config;
     ValveControlStrategy* strategy;
+    PowerLock pwmLock { "valve-pwm", ESP_PM_APB_FREQ_MAX };
 
     gpio_num_t in1Pin;
     gpio_num_t in2Pin;
@@ -36,22 +36,29 @@ class FlowControlApp : public AbstractFlowControlApp {
 public:
     FlowControlApp()
         : AbstractFlowControlApp(deviceConfig, valveController) {
+        // mk4 only has 192 kB for SPIFFS, but there's plenty of room here
+        for (auto field : { "volume", "battery", "temperature", "humidity", "soilTemperature", "soilMoisture" }) {
+            timeSeries.addSeries(field);
+        }
     }
 
     void beginPeripherials() override {
         resetWifi.begin(GPIO_NUM_0, INPUT_PULLUP);
 
-        telemetryPublisher.registerProvider(battery);
+        telemetryPublisher.registerProvider(battery, "battery");
         battery.begin(GPIO_NUM_1);
+        power.monitorBattery([&]() {
+            return battery.getLevel();
+        });
         if (deviceConfig.builtInEnvironmentSensor.get()) {
-            telemetryPublisher.registerProvider(builtInEnvironment);
+            registerEnvironmentSensor(builtInEnvironment, "builtInEnvironment");
             builtInEnvironment.begin();
         } else {
             Serial.println("Built-in environment sensor is disabled");
         }
 
         soilSensor.begin(GPIO_NUM_7, GPIO_NUM_6);
-        telemetryPublisher.registerProvider(soilSensor);
+        registerEnvironmentSensor(soilSensor, "soilSensor");
 
         valveController.begin(
             GPIO_NUM_16,    // IN1
@@ -65,8 +72,8 @@ public:
 private:
     FlowControlDeviceConfig deviceConfig;
     BattertHandler battery;
-    ShtC3Handler builtInEnvironment;
-    Ds18B20SoilSensorHandler soilSensor;
+    ShtC3Handler builtInEnvironment { tasks, power.scaled(config.samplingInterval) };
+    Ds18B20SoilSensorHandler soilSensor { tasks, power.scaled(config.samplingInterval) };
     Drv8874ValveController valveController { deviceConfig.valve };
     HeldButtonListener resetWifi { tasks, "Reset WIFI", seconds { 5 },
         [&]() {
@@ -12,7 +12,9 @@ class ShtC3Handler
     : public AbstractEnvironmentHandler {
 
 public:
-    ShtC3Handler() = default;
+    ShtC3Handler(TaskContainer& tasks, std::function<microseconds()> samplingInterval)
+        : AbstractEnvironmentHandler(tasks, "Sample SHTC3", samplingInterval) {
+    }
 
     void begin() {
         Serial.print("Initializing SHTC3 sensor\n");
@@ -27,18 +29,18 @@ public:
     }
 
 protected:
-    void populateTelemetryInternal(JsonObject& json) override {
+    void sampleInternal() override {
         if (!sht.sample()) {
             Serial.println("SHT.sample() failed");
             return;
         }
-        auto temperature = sht.readTempC();
-        auto humidity = sht.readHumidity();
-        json["temperature"] = temperature;
-        json["humidity"] = humidity;
+        temperature.record(sht.readTempC());
+        humidity.record(sht.readHumidity());
     }
 
 private:
+    Field temperature { this, "temperature" };
+    Field humidity { this, "humidity" };
 
     SHTC3 sht { Wire };
 };
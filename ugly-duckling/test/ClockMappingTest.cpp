@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include <ClockMapping.hpp>
+
+using farmhub::client::ClockMapping;
+
+class ClockMappingTest : public ::testing::Test {
+public:
+    ClockMapping mapping;
+    int64_t utcMillis = 0;
+};
+
+TEST_F(ClockMappingTest, unknown_before_synchronization) {
+    EXPECT_FALSE(mapping.isSynchronized());
+    EXPECT_FALSE(mapping.toUtcMillis(1000000, utcMillis));
+}
+
+TEST_F(ClockMappingTest, converts_times_captured_before_synchronization) {
+    // Captured 5 seconds after boot, synchronized 20 seconds after boot
+    int64_t capturedAt = 5000000;
+    EXPECT_EQ(mapping.synchronize(20000000, 1700000000000000LL), 0);
+
+    ASSERT_TRUE(mapping.toUtcMillis(capturedAt, utcMillis));
+    EXPECT_EQ(utcMillis, 1699999985000LL);
+}
+
+TEST_F(ClockMappingTest, resynchronization_reports_correction) {
+    mapping.synchronize(1000000, 1700000000000000LL);
+    // The clock drifted 250 ms an hour later
+    EXPECT_EQ(mapping.synchronize(3601000000LL, 1700003600250000LL), 250000);
+
+    ASSERT_TRUE(mapping.toUtcMillis(3601000000LL, utcMillis));
+    EXPECT_EQ(utcMillis, 1700003600250LL);
+}
+
+TEST_F(ClockMappingTest, rejects_unset_clock) {
+    EXPECT_FALSE(ClockMapping::isValidUtc(0));
+    EXPECT_FALSE(ClockMapping::isValidUtc(86400LL * 1000000));
+    EXPECT_TRUE(ClockMapping::isValidUtc(1700000000LL * 1000000));
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <GorillaCodec.hpp>
+
+using namespace farmhub::client;
+
+class GorillaCodecTest : public ::testing::Test {
+public:
+    std::vector<RawSample> roundtrip(const std::vector<RawSample>& samples) {
+        std::vector<uint8_t> buffer(samples.size() * sizeof(RawSample) + 16);
+        GorillaEncoder encoder(buffer.data(), buffer.size());
+        for (auto& sample : samples) {
+            EXPECT_TRUE(encoder.append(sample.time, sample.value));
+        }
+        EXPECT_EQ(encoder.getCount(), samples.size());
+
+        std::vector<RawSample> decoded;
+        GorillaDecoder decoder(buffer.data(), encoder.getSize(), encoder.getCount());
+        RawSample sample;
+        while (decoder.next(sample)) {
+            decoded.push_back(sample);
+        }
+        return decoded;
+    }
+
+    void expectSame(const std::vector<RawSample>& expected, const std::vector<RawSample>& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(expected[i].time, actual[i].time) << "at " << i;
+            // Compare bits so that NaNs and negative zeros are checked too
+            EXPECT_EQ(0, memcmp(&expected[i].value, &actual[i].value, sizeof(float))) << "at " << i;
+        }
+    }
+
+    /**
+     * @brief Telemetry the way a device reports it: every minute with some jitter, values at sensor resolution.
+     */
+    static std::vector<RawSample> fieldData(size_t count, float base, float amplitude, float resolution) {
+        std::vector<RawSample> samples;
+        uint32_t time = 1700000000;
+        uint32_t seed = 12345;
+        for (size_t i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            // Mostly on time, sometimes a second early or late
+            int jitter = (seed >> 16) % 8 == 0 ? ((seed >> 20) % 3) - 1 : 0;
+            time += 60 + jitter;
+            float daily = amplitude * sin(2 * M_PI * i / (24 * 60));
+            float value = std::round((base + daily) / resolution) * resolution;
+            samples.push_back({ time, value });
+        }
+        return samples;
+    }
+};
+
+TEST_F(GorillaCodecTest, empty_buffer_has_no_samples) {
+    uint8_t buffer[16];
+    GorillaEncoder encoder(buffer, sizeof(buffer));
+    EXPECT_EQ(encoder.getCount(), 0u);
+    EXPECT_EQ(encoder.getSize(), 0u);
+
+    GorillaDecoder decoder(buffer, encoder.getSize(), encoder.getCount());
+    RawSample sample;
+    EXPECT_FALSE(decoder.next(sample));
+}
+
+TEST_F(GorillaCodecTest, roundtrips_irregular_samples) {
+    std::vector<RawSample> samples {
+        { 1700000000, 21.5f },
+        { 1700000060, 21.5f },
+        { 1700000120, 21.6f },
+        { 1700000180, -3.25f },
+        { 1700000181, 0.0f },
+        { 1700000181, -0.0f },
+        { 1700003000, NAN },
+        { 1700003060, 1e30f },
+        { 1700003120, 1e-30f },
+        { 1800000000, 21.5f },
+    };
+    expectSame(samples, roundtrip(samples));
+}
+
+TEST_F(GorillaCodecTest, steady_samples_take_two_bits) {
+    uint8_t buffer[64];
+    GorillaEncoder encoder(buffer, sizeof(buffer));
+    ASSERT_TRUE(encoder.append(1700000000, 42));
+    ASSERT_TRUE(encoder.append(1700000060, 42));
+    size_t sizeAfterSecond = encoder.getSize();
+    for (int i = 2; i < 34; i++) {
+        ASSERT_TRUE(encoder.append(1700000000 + i * 60, 42));
+    }
+    // 32 more samples with the same delta and value take a bit each for time and value
+    EXPECT_EQ(encoder.getSize(), sizeAfterSecond + 8);
+}
+
+TEST_F(GorillaCodecTest, does_not_store_partial_samples_when_full) {
+    uint8_t buffer[16];
+    GorillaEncoder encoder(buffer, sizeof(buffer));
+    ASSERT_TRUE(encoder.append(1700000000, 1.0f));
+    ASSERT_TRUE(encoder.append(1700000060, 2.0f));
+    size_t count = 2;
+    while (encoder.append(1700000000 + count * 60 + count % 7, count * 1.37f)) {
+        count++;
+    }
+    EXPECT_EQ(encoder.getCount(), count);
+    EXPECT_LE(encoder.getSize(), sizeof(buffer));
+
+    // The sample that did not fit leaves no trace behind
+    GorillaDecoder decoder(buffer, encoder.getSize(), encoder.getCount());
+    RawSample sample;
+    size_t decoded = 0;
+    while (decoder.next(sample)) {
+        decoded++;
+    }
+    EXPECT_EQ(decoded, count);
+}
+
+TEST_F(GorillaCodecTest, roundtrips_field_data) {
+    auto samples = fieldData(1000, 18.0f, 6.0f, 0.1f);
+    expectSame(samples, roundtrip(samples));
+}
+
+/**
+ * @brief Reports the compression ratio and speed on field-like data; run with the native environment.
+ */
+TEST_F(GorillaCodecTest, benchmark) {
+    struct Field {
+        const char* name;
+        std::vector<RawSample> samples;
+    };
+    std::vector<Field> fields {
+        { "temperature", fieldData(1440, 18.0f, 6.0f, 0.1f) },
+        { "soilMoisture", fieldData(1440, 35.0f, 2.0f, 0.5f) },
+        { "battery", fieldData(1440, 3.9f, 0.05f, 0.01f) },
+        { "constant", fieldData(1440, 0.0f, 0.0f, 1.0f) },
+    };
+    for (auto& field : fields) {
+        auto& samples = field.samples;
+        size_t rawSize = samples.size() * sizeof(RawSample);
+        std::vector<uint8_t> buffer(rawSize + 16);
+
+        const int rounds = 100;
+        auto encodeStart = std::chrono::steady_clock::now();
+        size_t size = 0;
+        for (int round = 0; round < rounds; round++) {
+            GorillaEncoder encoder(buffer.data(), buffer.size());
+            for (auto& sample : samples) {
+                encoder.append(sample.time, sample.value);
+            }
+            size = encoder.getSize();
+        }
+        auto encodeTime = std::chrono::steady_clock::now() - encodeStart;
+
+        auto decodeStart = std::chrono::steady_clock::now();
+        size_t decoded = 0;
+        for (int round = 0; round < rounds; round++) {
+            GorillaDecoder decoder(buffer.data(), size, samples.size());
+            RawSample sample;
+            while (decoder.next(sample)) {
+                decoded++;
+            }
+        }
+        auto decodeTime = std::chrono::steady_clock::now() - decodeStart;
+        EXPECT_EQ(decoded, samples.size() * rounds);
+
+        double ratio = static_cast<double>(rawSize) / size;
+        double bitsPerSample = size * 8.0 / samples.size();
+        double encodeNs = std::chrono::duration<double, std::nano>(encodeTime).count() / (samples.size() * rounds);
+        double decodeNs = std::chrono::duration<double, std::nano>(decodeTime).count() / (samples.size() * rounds);
+        printf("%-14s %5zu samples, %6zu -> %5zu bytes, ratio %5.2f, %5.2f bits/sample, encode %6.1f ns/sample, decode %6.1f ns/sample\n",
+            field.name, samples.size(), rawSize, size, ratio, bitsPerSample, encodeNs, decodeNs);
+
+        // Slowly changing values at sensor resolution should compress at least 2:1
+        EXPECT_GT(ratio, 2.0) << field.name;
+    }
+}
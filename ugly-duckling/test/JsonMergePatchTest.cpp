@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include <JsonMergePatch.hpp>
+
+using farmhub::client::applyMergePatch;
+
+class JsonMergePatchTest : public ::testing::Test {
+public:
+    JsonMergePatchTest() = default;
+
+    std::string patch(const char* target, const char* patch) {
+        DynamicJsonDocument targetDoc(2048);
+        deserializeJson(targetDoc, target);
+        DynamicJsonDocument patchDoc(2048);
+        deserializeJson(patchDoc, patch);
+        applyMergePatch(targetDoc.as<JsonVariant>(), patchDoc.as<JsonVariantConst>());
+        std::string result;
+        serializeJson(targetDoc, result);
+        return result;
+    }
+};
+
+// Test cases from RFC 7386 Appendix A
+
+TEST_F(JsonMergePatchTest, replaces_existing_member) {
+    EXPECT_EQ(patch(R"({"a":"b"})", R"({"a":"c"})"), R"({"a":"c"})");
+}
+
+TEST_F(JsonMergePatchTest, adds_new_member) {
+    EXPECT_EQ(patch(R"({"a":"b"})", R"({"b":"c"})"), R"({"a":"b","b":"c"})");
+}
+
+TEST_F(JsonMergePatchTest, removes_member_patched_with_null) {
+    EXPECT_EQ(patch(R"({"a":"b"})", R"({"a":null})"), R"({})");
+    EXPECT_EQ(patch(R"({"a":"b","b":"c"})", R"({"a":null})"), R"({"b":"c"})");
+}
+
+TEST_F(JsonMergePatchTest, replaces_arrays_as_a_whole) {
+    EXPECT_EQ(patch(R"({"a":["b"]})", R"({"a":"c"})"), R"({"a":"c"})");
+    EXPECT_EQ(patch(R"({"a":"c"})", R"({"a":["b"]})"), R"({"a":["b"]})");
+    EXPECT_EQ(patch(R"({"a":[{"b":"c"}]})", R"({"a":[1]})"), R"({"a":[1]})");
+    EXPECT_EQ(patch(R"(["a","b"])", R"(["c","d"])"), R"(["c","d"])");
+}
+
+TEST_F(JsonMergePatchTest, merges_nested_objects) {
+    EXPECT_EQ(patch(R"({"a":{"b":"c"}})", R"({"a":{"b":"d","c":null}})"), R"({"a":{"b":"d"}})");
+}
+
+TEST_F(JsonMergePatchTest, replaces_target_with_non_object_patch) {
+    EXPECT_EQ(patch(R"({"a":"b"})", R"(["c"])"), R"(["c"])");
+    EXPECT_EQ(patch(R"({"a":"foo"})", R"(null)"), R"(null)");
+    EXPECT_EQ(patch(R"({"a":"foo"})", R"("bar")"), R"("bar")");
+}
+
+TEST_F(JsonMergePatchTest, keeps_nulls_out_of_new_objects) {
+    EXPECT_EQ(patch(R"({"e":null})", R"({"a":1})"), R"({"e":null,"a":1})");
+    EXPECT_EQ(patch(R"([1,2])", R"({"a":"b","c":null})"), R"({"a":"b"})");
+    EXPECT_EQ(patch(R"({})", R"({"a":{"bb":{"ccc":null}}})"), R"({"a":{"bb":{}}})");
+}
+
+TEST_F(JsonMergePatchTest, patches_schedule_of_configuration) {
+    EXPECT_EQ(
+        patch(
+            R"({"heartbeat":60,"meter":{"qFactor":5},"schedule":[{"start":"2020-01-01T00:00:00Z","period":60,"duration":15}]})",
+            R"({"meter":{"noFlowTimeout":300},"schedule":[]})"),
+        R"({"heartbeat":60,"meter":{"qFactor":5,"noFlowTimeout":300},"schedule":[]})");
+}
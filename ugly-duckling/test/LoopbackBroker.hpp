@@ -0,0 +1,117 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <MqttSession.hpp>
+
+using farmhub::client::MqttClient;
+
+struct PublishedMessage {
+    std::string topic;
+    std::string payload;
+    bool retain;
+    int qos;
+};
+
+/**
+ * @brief Stands in for the MQTT broker in the same process.
+ *
+ * Messages published to a topic the session is subscribed to are delivered back to it, like the broker would.
+ */
+class LoopbackBroker : public MqttClient {
+public:
+    bool connect(const std::string& clientId) override {
+        connectAttempts++;
+        if (refuseConnections > 0) {
+            refuseConnections--;
+            return false;
+        }
+        isConnected = true;
+        // Clean session
+        subscriptions.clear();
+        return true;
+    }
+
+    void disconnect() override {
+        isConnected = false;
+    }
+
+    bool connected() override {
+        return isConnected;
+    }
+
+    bool publish(const std::string& topic, const std::string& payload, bool retain, int qos) override {
+        if (!isConnected) {
+            return false;
+        }
+        published.push_back({ topic, payload, retain, qos });
+        if (isSubscribed(topic)) {
+            send(topic, payload);
+        }
+        return true;
+    }
+
+    bool subscribe(const std::string& topic, int qos) override {
+        if (!isConnected) {
+            return false;
+        }
+        subscriptions.push_back({ topic, "", false, qos });
+        return true;
+    }
+
+    void onMessage(std::function<void(const std::string& topic, const std::string& payload)> handler) override {
+        this->handler = handler;
+    }
+
+    void loop() override {
+        std::vector<PublishedMessage> delivering;
+        delivering.swap(incoming);
+        for (auto& message : delivering) {
+            handler(message.topic, message.payload);
+        }
+    }
+
+    /**
+     * @brief Queues a message from the cloud to be received by the next <code>loop()</code>.
+     */
+    void send(const std::string& topic, const std::string& payload) {
+        incoming.push_back({ topic, payload, false, 0 });
+    }
+
+    void dropConnection() {
+        isConnected = false;
+    }
+
+    std::vector<std::string> subscribedTopics() const {
+        std::vector<std::string> topics;
+        for (auto& subscription : subscriptions) {
+            topics.push_back(subscription.topic);
+        }
+        return topics;
+    }
+
+    bool isConnected = false;
+    int refuseConnections = 0;
+    int connectAttempts = 0;
+    std::vector<PublishedMessage> subscriptions;
+    std::vector<PublishedMessage> published;
+
+private:
+    bool isSubscribed(const std::string& topic) const {
+        for (auto& subscription : subscriptions) {
+            const std::string& filter = subscription.topic;
+            if (filter == topic) {
+                return true;
+            }
+            if (filter.back() == '#' && topic.compare(0, filter.length() - 1, filter, 0, filter.length() - 1) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::function<void(const std::string&, const std::string&)> handler;
+    std::vector<PublishedMessage> incoming;
+};
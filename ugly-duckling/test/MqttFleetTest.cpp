@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <MqttSession.hpp>
+
+#include "LoopbackBroker.hpp"
+
+using namespace farmhub::client;
+
+using FleetSession = MqttSession<std::chrono::steady_clock, 16>;
+
+/**
+ * @brief A virtual flow control device running the firmware's MQTT session, with synthetic telemetry.
+ */
+class VirtualDevice {
+public:
+    VirtualDevice(int index)
+        : instance("sim-" + std::to_string(index))
+        , topic("devices/ugly-duckling/" + instance)
+        // Spread valve changes over the fleet
+        , valvePhase(index % 15) {
+        session.begin("ugly-duckling-" + instance, topic);
+        session.onConfig([&](const std::string& payload) {
+            configUpdates++;
+            return true;
+        });
+        session.registerCommand("ping", [](const std::string& request, std::string& response) {
+            response = "{\"pong\":true}";
+        });
+    }
+
+    /**
+     * @brief Does the work of one heartbeat, and returns the CPU time it took.
+     */
+    std::clock_t heartbeat(int beat) {
+        std::clock_t start = std::clock();
+        if (!session.connect()) {
+            return std::clock() - start;
+        }
+        char payload[256];
+        snprintf(payload, sizeof(payload), "{\"battery\":%.2f,\"uptime\":%d}", 3.9 - beat * 0.001, beat * 60);
+        publish("telemetry", payload);
+        snprintf(payload, sizeof(payload), "{\"volume\":%.1f}", valveOpen ? 12.5 : 0.0);
+        publish("telemetry/flow", payload);
+        if (beat % 5 == 0) {
+            snprintf(payload, sizeof(payload),
+                "{\"temperature\":{\"min\":%.1f,\"max\":%.1f,\"mean\":%.1f,\"last\":%.1f,\"count\":4},"
+                "\"soilMoisture\":{\"min\":31.0,\"max\":33.5,\"mean\":32.2,\"last\":32.0,\"count\":4}}",
+                18.0, 19.5, 18.7, 19.0);
+            publish("telemetry/environment", payload);
+        }
+        if (beat % 15 == valvePhase) {
+            valveOpen = !valveOpen;
+            publish("events/valve/state", valveOpen ? "{\"state\":\"OPEN\"}" : "{\"state\":\"CLOSED\"}");
+        }
+        session.flush();
+        session.loop();
+        // Responses to commands received in this loop
+        session.flush();
+        return std::clock() - start;
+    }
+
+    void publish(const std::string& suffix, const char* payload) {
+        FleetSession::Message message;
+        message.topic = topic + "/" + suffix;
+        message.payload = payload;
+        message.capturedAt = std::chrono::steady_clock::now();
+        session.publish(std::move(message));
+    }
+
+    const std::string instance;
+    const std::string topic;
+    LoopbackBroker broker;
+    FleetSession session { broker };
+    int configUpdates = 0;
+
+private:
+    const int valvePhase;
+    bool valveOpen = false;
+};
+
+/**
+ * @brief Runs a fleet of virtual devices for an hour of heartbeats, and reports the message rate and the CPU time each device spends.
+ *
+ * The devices run the firmware's MQTT session rather than a reimplementation of the protocol. The broker
+ * is a loopback stand-in, and CPU time is measured on the host, so compare numbers between runs, not with the device.
+ */
+TEST(MqttFleetTest, simulated_fleet) {
+    const int devices = 500;
+    const int heartbeats = 60;
+
+    std::vector<std::unique_ptr<VirtualDevice>> fleet;
+    for (int i = 0; i < devices; i++) {
+        fleet.emplace_back(new VirtualDevice(i));
+    }
+    std::vector<std::clock_t> cpu(devices, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int beat = 0; beat < heartbeats; beat++) {
+        for (int i = 0; i < devices; i++) {
+            auto& device = *fleet[i];
+            if (beat == 0) {
+                // The retained configuration arrives right after subscribing
+                device.broker.send(device.topic + "/config", "{\"heartbeat\":60}");
+            }
+            if (beat % 10 == 9) {
+                device.broker.send(device.topic + "/commands/ping", "{}");
+            }
+            // Reconnect a few devices, like after WiFi trouble
+            if (beat == 30 && i % 50 == 0) {
+                device.broker.dropConnection();
+            }
+            cpu[i] += device.heartbeat(beat);
+        }
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned long published = 0;
+    std::clock_t totalCpu = 0;
+    std::clock_t maxCpu = 0;
+    for (int i = 0; i < devices; i++) {
+        auto& metrics = fleet[i]->session.getMetrics();
+        published += metrics.published;
+        EXPECT_EQ(metrics.dropped, 0ul);
+        EXPECT_EQ(metrics.commands.count, (unsigned long) heartbeats / 10);
+        EXPECT_EQ(fleet[i]->configUpdates, 1);
+        totalCpu += cpu[i];
+        maxCpu = std::max(maxCpu, cpu[i]);
+    }
+    EXPECT_EQ(fleet[0]->session.getMetrics().connects.count, 2ul);
+
+    double cpuPerBeatUs = 1000000.0 * totalCpu / CLOCKS_PER_SEC / devices / heartbeats;
+    printf("%d devices, %d heartbeats: %lu messages in %.2f s, %.0f messages/s\n",
+        devices, heartbeats, published, wallSeconds, published / wallSeconds);
+    printf("CPU per device: %.2f us per heartbeat on average, %.2f ms per hour at most\n",
+        cpuPerBeatUs, 1000.0 * maxCpu / CLOCKS_PER_SEC);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <MqttPublishQueue.hpp>
+
+using farmhub::client::MqttPublishQueue;
+
+struct TestMessage {
+    std::string topic;
+    std::string payload;
+};
+
+/**
+ * @brief Stands in for the MQTT broker, with injectable latency and loss.
+ *
+ * Time is simulated, so that slow brokers can be tested without waiting.
+ */
+class BrokerStandIn {
+public:
+    BrokerStandIn(std::chrono::microseconds latency = std::chrono::microseconds::zero(), double lossRate = 0.0)
+        : latency(latency)
+        , lossRate(lossRate) {
+    }
+
+    bool publish(const TestMessage& message) {
+        if (!connected) {
+            return false;
+        }
+        // Waiting for the acknowledgement takes a round trip even if the message is lost
+        elapsed += latency;
+        if (loss(random) < lossRate) {
+            return false;
+        }
+        received.push_back(message);
+        return true;
+    }
+
+    std::vector<std::string> receivedPayloads() const {
+        std::vector<std::string> payloads;
+        for (auto& message : received) {
+            payloads.push_back(message.payload);
+        }
+        return payloads;
+    }
+
+    const std::chrono::microseconds latency;
+    const double lossRate;
+    bool connected = true;
+    std::chrono::microseconds elapsed = std::chrono::microseconds::zero();
+    std::vector<TestMessage> received;
+
+private:
+    std::mt19937 random { 42 };
+    std::uniform_real_distribution<double> loss { 0.0, 1.0 };
+};
+
+using TestQueue = MqttPublishQueue<TestMessage, 4>;
+
+class MqttPublishQueueTest : public ::testing::Test {
+public:
+    template <typename Queue>
+    typename Queue::FlushResult flush(Queue& queue, BrokerStandIn& broker) {
+        return queue.flush([&](const TestMessage& message) {
+            return broker.publish(message);
+        });
+    }
+};
+
+TEST_F(MqttPublishQueueTest, publishes_in_order) {
+    TestQueue queue;
+    BrokerStandIn broker;
+    EXPECT_TRUE(queue.push({ "telemetry", "1" }));
+    EXPECT_TRUE(queue.push({ "telemetry", "2" }));
+    EXPECT_TRUE(queue.push({ "telemetry", "3" }));
+    EXPECT_EQ(queue.size(), 3);
+
+    auto result = flush(queue, broker);
+    EXPECT_EQ(result.published, 3);
+    EXPECT_EQ(result.failed, 0);
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(broker.receivedPayloads(), (std::vector<std::string> { "1", "2", "3" }));
+}
+
+TEST_F(MqttPublishQueueTest, drops_oldest_when_full) {
+    TestQueue queue;
+    BrokerStandIn broker;
+    for (int i = 1; i <= 4; i++) {
+        EXPECT_TRUE(queue.push({ "telemetry", std::to_string(i) }));
+    }
+    EXPECT_FALSE(queue.push({ "telemetry", "5" }));
+    EXPECT_FALSE(queue.push({ "telemetry", "6" }));
+    EXPECT_EQ(queue.size(), 4);
+
+    flush(queue, broker);
+    EXPECT_EQ(broker.receivedPayloads(), (std::vector<std::string> { "3", "4", "5", "6" }));
+}
+
+TEST_F(MqttPublishQueueTest, lost_messages_are_not_retried) {
+    TestQueue queue;
+    BrokerStandIn broker { std::chrono::milliseconds { 10 }, 1.0 };
+    queue.push({ "telemetry", "1" });
+    queue.push({ "telemetry", "2" });
+
+    auto result = flush(queue, broker);
+    EXPECT_EQ(result.published, 0);
+    EXPECT_EQ(result.failed, 2);
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(broker.elapsed, std::chrono::milliseconds { 20 });
+}
+
+TEST_F(MqttPublishQueueTest, keeps_messages_queued_while_disconnected) {
+    TestQueue queue;
+    BrokerStandIn broker;
+    broker.connected = false;
+    queue.push({ "telemetry", "1" });
+    queue.push({ "events/valve/state", "2" });
+    // MqttHandler only flushes while connected
+    EXPECT_EQ(queue.size(), 2);
+
+    broker.connected = true;
+    auto result = flush(queue, broker);
+    EXPECT_EQ(result.published, 2);
+    EXPECT_EQ(broker.receivedPayloads(), (std::vector<std::string> { "1", "2" }));
+}
+
+TEST_F(MqttPublishQueueTest, messages_queued_while_flushing_are_published) {
+    TestQueue queue;
+    BrokerStandIn broker;
+    queue.push({ "telemetry/batch", "1" });
+
+    auto result = queue.flush([&](const TestMessage& message) {
+        if (message.payload == "1") {
+            // Like a publish callback queueing a follow-up message
+            queue.push({ "telemetry/batch", "2" });
+        }
+        return broker.publish(message);
+    });
+    EXPECT_EQ(result.published, 2);
+    EXPECT_EQ(broker.receivedPayloads(), (std::vector<std::string> { "1", "2" }));
+}
+
+TEST_F(MqttPublishQueueTest, benchmark) {
+    const int messages = 20000;
+    const std::string payload(200, 'x');
+    for (auto latency : { std::chrono::microseconds::zero(), std::chrono::microseconds { 2000 } }) {
+        for (double lossRate : { 0.0, 0.05 }) {
+            MqttPublishQueue<TestMessage, 16> queue;
+            BrokerStandIn broker { latency, lossRate };
+            size_t published = 0;
+            size_t dropped = 0;
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < messages; i++) {
+                if (!queue.push({ "telemetry", payload })) {
+                    dropped++;
+                }
+                // Flush like the MQTT task does, after a burst of messages
+                if (i % 8 == 7) {
+                    published += flush(queue, broker).published;
+                }
+            }
+            published += flush(queue, broker).published;
+            auto time = std::chrono::steady_clock::now() - start;
+
+            EXPECT_EQ(dropped, 0);
+            EXPECT_EQ(published, broker.received.size());
+            if (lossRate == 0.0) {
+                EXPECT_EQ(published, messages);
+            }
+
+            // Only the queueing overhead is measured here, see MqttSessionTest for the whole publish path
+            double queueNs = std::chrono::duration<double, std::nano>(time).count() / messages;
+            printf("latency %5ld us, loss %4.1f%%: %6zu published, queueing %6.1f ns/message\n",
+                (long) latency.count(), lossRate * 100, published, queueNs);
+        }
+    }
+}
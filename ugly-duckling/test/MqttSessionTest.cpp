@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <MqttSession.hpp>
+
+#include "LoopbackBroker.hpp"
+
+using namespace farmhub::client;
+
+using TestSession = MqttSession<std::chrono::steady_clock, 16>;
+
+class MqttSessionTest : public ::testing::Test {
+public:
+    MqttSessionTest() {
+        session.begin("test-client", "devices/test");
+    }
+
+    TestSession::Message message(const std::string& suffix, const std::string& payload) {
+        TestSession::Message message;
+        message.topic = "devices/test/" + suffix;
+        message.payload = payload;
+        return message;
+    }
+
+    LoopbackBroker broker;
+    TestSession session { broker };
+};
+
+TEST_F(MqttSessionTest, subscribes_when_connected) {
+    EXPECT_TRUE(session.connect());
+    EXPECT_EQ(broker.subscribedTopics(), (std::vector<std::string> { "devices/test/config", "devices/test/config/patch", "devices/test/commands/#" }));
+    for (auto& subscription : broker.subscriptions) {
+        EXPECT_EQ(subscription.qos, 2);
+    }
+
+    // Already connected
+    EXPECT_TRUE(session.connect());
+    EXPECT_EQ(broker.connectAttempts, 1);
+    EXPECT_EQ(session.getMetrics().connects.count, 1ul);
+}
+
+TEST_F(MqttSessionTest, reconnects_and_resubscribes) {
+    broker.refuseConnections = 2;
+    EXPECT_FALSE(session.connect());
+    EXPECT_FALSE(session.connect());
+    EXPECT_TRUE(session.connect());
+    EXPECT_EQ(session.getMetrics().failedConnects, 2ul);
+
+    broker.dropConnection();
+    EXPECT_FALSE(session.isConnected());
+    EXPECT_TRUE(session.connect());
+    EXPECT_EQ(broker.subscriptions.size(), 3u);
+    EXPECT_EQ(session.getMetrics().connects.count, 2ul);
+}
+
+TEST_F(MqttSessionTest, routes_configuration_updates) {
+    std::vector<std::string> updates;
+    session.onConfig([&](const std::string& payload) {
+        updates.push_back(payload);
+        return true;
+    });
+    session.onConfigPatch([&](const std::string& payload) {
+        // Rejected like a patch with unknown keys
+        return false;
+    });
+    session.connect();
+
+    broker.send("devices/test/config", "{\"a\":1}");
+    broker.send("devices/test/config/patch", "{\"b\":2}");
+    session.loop();
+    EXPECT_EQ(updates, (std::vector<std::string> { "{\"a\":1}" }));
+    EXPECT_EQ(session.getMetrics().configUpdates.count, 1ul);
+    EXPECT_EQ(session.getMetrics().rejectedConfigUpdates, 1ul);
+}
+
+TEST_F(MqttSessionTest, handles_commands) {
+    std::vector<std::string> requests;
+    session.registerCommand("ping", [&](const std::string& request, std::string& response) {
+        requests.push_back(request);
+        response = "{\"pong\":true}";
+    });
+    session.connect();
+
+    broker.send("devices/test/commands/ping", "{\"id\":1}");
+    session.loop();
+    EXPECT_EQ(requests, (std::vector<std::string> { "{\"id\":1}" }));
+    // The command topic is cleared right away
+    ASSERT_EQ(broker.published.size(), 1u);
+    EXPECT_EQ(broker.published[0].topic, "devices/test/commands/ping");
+    EXPECT_EQ(broker.published[0].payload, "");
+    EXPECT_TRUE(broker.published[0].retain);
+
+    // The response is queued
+    EXPECT_EQ(session.queuedMessages(), 1u);
+    session.flush();
+    ASSERT_EQ(broker.published.size(), 2u);
+    EXPECT_EQ(broker.published[1].topic, "devices/test/responses/ping");
+    EXPECT_EQ(broker.published[1].payload, "{\"pong\":true}");
+    EXPECT_EQ(broker.published[1].qos, 2);
+
+    // Clearing the command topic comes back empty, and is ignored
+    session.loop();
+    EXPECT_EQ(requests.size(), 1u);
+    EXPECT_EQ(session.getMetrics().commands.count, 1ul);
+}
+
+TEST_F(MqttSessionTest, reports_unknown_messages) {
+    std::vector<std::string> unknown;
+    session.onUnknownMessage([&](const std::string& topic) {
+        unknown.push_back(topic);
+    });
+    session.registerCommand("quiet", [&](const std::string& request, std::string& response) {
+    });
+    session.connect();
+
+    broker.send("devices/test/commands/quiet", "{}");
+    broker.send("devices/test/commands/unknown", "{}");
+    broker.send("devices/test/other", "{}");
+    session.loop();
+    EXPECT_EQ(unknown, (std::vector<std::string> { "devices/test/commands/unknown", "devices/test/other" }));
+    // Commands without a response publish nothing but the cleared command topic
+    EXPECT_EQ(session.queuedMessages(), 0u);
+}
+
+TEST_F(MqttSessionTest, timestamps_messages_when_clock_is_known) {
+    bool clockKnown = false;
+    session.onTimestamp([&](std::chrono::steady_clock::time_point time, int64_t& utcMillis) {
+        utcMillis = 1700000000000;
+        return clockKnown;
+    });
+    session.connect();
+
+    auto timestamped = message("telemetry", "{\"a\":1}");
+    timestamped.capturedAt = std::chrono::steady_clock::now();
+    session.publish(timestamped);
+    session.flush();
+    EXPECT_EQ(broker.published.back().payload, "{\"a\":1}");
+
+    clockKnown = true;
+    session.publish(timestamped);
+    auto empty = message("sleep", "{}");
+    empty.capturedAt = timestamped.capturedAt;
+    session.publish(empty);
+    session.publish(message("events", "{\"b\":2}"));
+    session.flush();
+    ASSERT_EQ(broker.published.size(), 4u);
+    EXPECT_EQ(broker.published[1].payload, "{\"a\":1,\"timestamp\":1700000000000}");
+    EXPECT_EQ(broker.published[2].payload, "{\"timestamp\":1700000000000}");
+    EXPECT_EQ(broker.published[3].payload, "{\"b\":2}");
+}
+
+TEST_F(MqttSessionTest, failed_messages_are_dropped) {
+    int published = 0;
+    auto failing = message("telemetry", "{}");
+    failing.onPublished = [&]() {
+        published++;
+    };
+    session.publish(failing);
+    session.flush();
+    EXPECT_EQ(published, 0);
+    EXPECT_EQ(session.queuedMessages(), 0u);
+    EXPECT_EQ(session.getMetrics().failed, 1ul);
+
+    session.connect();
+    session.publish(failing);
+    session.flush();
+    EXPECT_EQ(published, 1);
+    EXPECT_EQ(session.getMetrics().published, 1ul);
+}
+
+/**
+ * @brief Measures the wall time the device side of the protocol takes, without the network, the broker and JSON handling.
+ */
+TEST_F(MqttSessionTest, benchmark) {
+    using std::chrono::steady_clock;
+    auto report = [](const char* operation, int count, steady_clock::duration time) {
+        double us = std::chrono::duration<double, std::micro>(time).count() / count;
+        printf("%-20s %8.2f us, %10.0f per second\n", operation, us, 1000000 / us);
+    };
+    const int count = 20000;
+    const std::string payload(200, 'x');
+
+    session.onConfig([](const std::string& payload) {
+        return true;
+    });
+    session.registerCommand("ping", [](const std::string& request, std::string& response) {
+        response = "{\"pong\":true}";
+    });
+    session.onTimestamp([](steady_clock::time_point time, int64_t& utcMillis) {
+        utcMillis = 1700000000000;
+        return true;
+    });
+    ASSERT_TRUE(session.connect());
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        auto telemetry = message("telemetry", "{\"value\":\"" + payload + "\"}");
+        telemetry.capturedAt = steady_clock::now();
+        session.publish(std::move(telemetry));
+        // Flush like the MQTT task does, after a burst of messages
+        if (i % 8 == 7) {
+            session.flush();
+        }
+    }
+    session.flush();
+    report("publish", count, steady_clock::now() - start);
+    EXPECT_EQ(session.getMetrics().published, (unsigned long) count);
+    EXPECT_EQ(session.getMetrics().dropped, 0ul);
+    broker.published.clear();
+
+    start = steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        broker.send("devices/test/commands/ping", "{}");
+        session.loop();
+        session.flush();
+        // Receive the cleared command topic, too
+        session.loop();
+    }
+    report("command round-trip", count, steady_clock::now() - start);
+    EXPECT_EQ(session.getMetrics().commands.count, (unsigned long) count);
+    broker.published.clear();
+
+    start = steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        broker.send("devices/test/config", payload);
+        session.loop();
+    }
+    report("config update", count, steady_clock::now() - start);
+    EXPECT_EQ(session.getMetrics().configUpdates.count, (unsigned long) count);
+
+    start = steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        broker.dropConnection();
+        session.connect();
+    }
+    report("reconnect", count, steady_clock::now() - start);
+    EXPECT_EQ(session.getMetrics().connects.count, (unsigned long) count + 1);
+}
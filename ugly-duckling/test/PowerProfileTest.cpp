@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include <PowerProfile.hpp>
+
+using namespace farmhub::client;
+
+class PowerProfileTest : public ::testing::Test {
+public:
+    PowerProfileSelector selector { 1800, 2400, 50 };
+};
+
+TEST_F(PowerProfileTest, selects_profile_by_battery_level) {
+    EXPECT_EQ(selector.select(PowerProfile::Balanced, 1700), PowerProfile::BatterySaver);
+    EXPECT_EQ(selector.select(PowerProfile::Balanced, 2000), PowerProfile::Balanced);
+    EXPECT_EQ(selector.select(PowerProfile::Balanced, 2500), PowerProfile::Performance);
+}
+
+TEST_F(PowerProfileTest, leaves_battery_saver_only_past_hysteresis) {
+    EXPECT_EQ(selector.select(PowerProfile::BatterySaver, 1820), PowerProfile::BatterySaver);
+    EXPECT_EQ(selector.select(PowerProfile::BatterySaver, 1860), PowerProfile::Balanced);
+}
+
+TEST_F(PowerProfileTest, leaves_performance_only_past_hysteresis) {
+    EXPECT_EQ(selector.select(PowerProfile::Performance, 2380), PowerProfile::Performance);
+    EXPECT_EQ(selector.select(PowerProfile::Performance, 2340), PowerProfile::Balanced);
+}
+
+TEST_F(PowerProfileTest, zero_thresholds_are_disabled) {
+    PowerProfileSelector lowOnly { 1800, 0, 50 };
+    EXPECT_EQ(lowOnly.select(PowerProfile::Balanced, 4095), PowerProfile::Balanced);
+    EXPECT_EQ(lowOnly.select(PowerProfile::Balanced, 100), PowerProfile::BatterySaver);
+
+    PowerProfileSelector disabled { 0, 0, 50 };
+    EXPECT_EQ(disabled.select(PowerProfile::Performance, 0), PowerProfile::Balanced);
+}
+
+TEST_F(PowerProfileTest, battery_saver_scales_intervals) {
+    EXPECT_EQ(PowerSettings::forProfile(PowerProfile::Performance).intervalScale, 1);
+    EXPECT_GT(PowerSettings::forProfile(PowerProfile::BatterySaver).intervalScale, 1);
+    EXPECT_LT(PowerSettings::forProfile(PowerProfile::BatterySaver).maxCpuFreqMhz,
+        PowerSettings::forProfile(PowerProfile::Performance).maxCpuFreqMhz);
+}
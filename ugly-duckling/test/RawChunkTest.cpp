@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <commands/RawChunk.hpp>
+
+using farmhub::client::commands::RawChunk;
+
+class RawChunkTest : public ::testing::Test {
+public:
+    size_t fit(const std::string& text, size_t maxEscapedSize, bool more = true) {
+        return RawChunk::fit(reinterpret_cast<const uint8_t*>(text.data()), text.size(), maxEscapedSize, more);
+    }
+};
+
+TEST_F(RawChunkTest, plain_text_fits_as_is) {
+    EXPECT_EQ(fit("hello", 5), 5);
+    EXPECT_EQ(fit("hello world", 5), 5);
+}
+
+TEST_F(RawChunkTest, escaped_characters_take_up_more_space) {
+    EXPECT_EQ(fit("a\"b\\c", 5), 3);
+    EXPECT_EQ(fit("\n\n\n\n", 6), 3);
+    EXPECT_EQ(fit("\x01\x02", 11), 1);
+    EXPECT_EQ(fit("\x01", 5), 0);
+}
+
+TEST_F(RawChunkTest, does_not_split_utf8_characters) {
+    // "é" is two bytes, "€" three, "🌱" four
+    EXPECT_EQ(fit("ab\xC3\xA9", 3), 2);
+    EXPECT_EQ(fit("a\xE2\x82\xAC", 3), 1);
+    EXPECT_EQ(fit("a\xF0\x9F\x8C\xB1", 4), 1);
+    EXPECT_EQ(fit("a\xF0\x9F\x8C\xB1", 5), 5);
+}
+
+TEST_F(RawChunkTest, does_not_split_utf8_at_end_of_chunk) {
+    // The chunk read from the file ends mid-character, but the file continues
+    EXPECT_EQ(fit("ab\xE2\x82", 100, true), 2);
+    // Invalid UTF-8 at the end of the file is sent anyway
+    EXPECT_EQ(fit("ab\xE2\x82", 100, false), 4);
+}
+
+TEST_F(RawChunkTest, leaves_invalid_utf8_alone) {
+    EXPECT_EQ(fit("ab\x82\x82", 3), 3);
+    // Trimming would leave nothing to send
+    EXPECT_EQ(fit("\xE2\x82", 100), 2);
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <RtcMessageBuffer.hpp>
+
+using farmhub::client::RtcMessageBuffer;
+
+using TestBuffer = RtcMessageBuffer<32>;
+
+class RtcMessageBufferTest : public ::testing::Test {
+public:
+    bool append(TestBuffer& buffer, const std::string& message) {
+        return buffer.append(reinterpret_cast<const uint8_t*>(message.data()), message.size());
+    }
+
+    std::vector<std::string> messages(const TestBuffer& buffer) {
+        std::vector<std::string> result;
+        buffer.forEach([&](const uint8_t* message, size_t length) {
+            result.emplace_back(reinterpret_cast<const char*>(message), length);
+        });
+        return result;
+    }
+
+    // Like RTC memory after power-up
+    TestBuffer::Slot slot {};
+};
+
+TEST_F(RtcMessageBufferTest, empty_after_power_up) {
+    TestBuffer buffer(slot, 1);
+    EXPECT_FALSE(buffer.begin());
+    EXPECT_EQ(buffer.getCount(), 0u);
+    EXPECT_TRUE(messages(buffer).empty());
+}
+
+TEST_F(RtcMessageBufferTest, keeps_messages_across_wakes) {
+    TestBuffer buffer(slot, 1);
+    buffer.begin();
+    EXPECT_TRUE(append(buffer, "first"));
+
+    TestBuffer afterWake(slot, 1);
+    EXPECT_TRUE(afterWake.begin());
+    EXPECT_TRUE(append(afterWake, "second"));
+
+    EXPECT_EQ(afterWake.getCount(), 2u);
+    EXPECT_EQ(afterWake.getUsed(), 2u + 5 + 2 + 6);
+    EXPECT_EQ(messages(afterWake), (std::vector<std::string> { "first", "second" }));
+}
+
+TEST_F(RtcMessageBufferTest, rejects_message_that_does_not_fit) {
+    TestBuffer buffer(slot, 1);
+    buffer.begin();
+    EXPECT_TRUE(append(buffer, std::string(20, 'a')));
+    EXPECT_FALSE(append(buffer, std::string(9, 'b')));
+    EXPECT_TRUE(append(buffer, std::string(8, 'c')));
+    EXPECT_EQ(buffer.getUsed(), 32u);
+    EXPECT_EQ(messages(buffer), (std::vector<std::string> { std::string(20, 'a'), std::string(8, 'c') }));
+}
+
+TEST_F(RtcMessageBufferTest, discards_corrupted_messages) {
+    TestBuffer buffer(slot, 1);
+    buffer.begin();
+    append(buffer, "first");
+    slot.data[3] ^= 0x01;
+
+    TestBuffer afterWake(slot, 1);
+    EXPECT_FALSE(afterWake.begin());
+    EXPECT_EQ(afterWake.getCount(), 0u);
+}
+
+TEST_F(RtcMessageBufferTest, discards_messages_of_other_version) {
+    TestBuffer buffer(slot, 1);
+    buffer.begin();
+    append(buffer, "first");
+
+    TestBuffer afterUpdate(slot, 2);
+    EXPECT_FALSE(afterUpdate.begin());
+    EXPECT_EQ(afterUpdate.getCount(), 0u);
+}
+
+TEST_F(RtcMessageBufferTest, clear_removes_messages) {
+    TestBuffer buffer(slot, 1);
+    buffer.begin();
+    append(buffer, "first");
+    buffer.clear();
+    EXPECT_EQ(buffer.getCount(), 0u);
+    EXPECT_TRUE(TestBuffer(slot, 1).begin());
+}
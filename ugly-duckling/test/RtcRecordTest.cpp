@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include <RtcRecord.hpp>
+
+using farmhub::client::RtcRecord;
+
+struct TestState {
+    int32_t counter;
+    double volume;
+};
+
+using TestRecord = RtcRecord<TestState, 32>;
+
+class RtcRecordTest : public ::testing::Test {
+public:
+    // Like RTC memory after power-up
+    TestRecord::Slot slot {};
+    TestState state { 0, 0 };
+};
+
+TEST_F(RtcRecordTest, nothing_to_restore_after_power_up) {
+    TestRecord record(slot, 1);
+    EXPECT_FALSE(record.restore(state));
+}
+
+TEST_F(RtcRecordTest, restores_saved_state) {
+    TestRecord record(slot, 1);
+    record.save({ 42, 12.5 });
+
+    TestRecord afterWake(slot, 1);
+    ASSERT_TRUE(afterWake.restore(state));
+    EXPECT_EQ(state.counter, 42);
+    EXPECT_EQ(state.volume, 12.5);
+}
+
+TEST_F(RtcRecordTest, ignores_state_saved_with_other_version) {
+    TestRecord(slot, 1).save({ 42, 12.5 });
+
+    TestRecord afterUpdate(slot, 2);
+    EXPECT_FALSE(afterUpdate.restore(state));
+    EXPECT_EQ(state.counter, 0);
+}
+
+TEST_F(RtcRecordTest, ignores_corrupted_state) {
+    TestRecord record(slot, 1);
+    record.save({ 42, 12.5 });
+    slot.data[0] ^= 0x01;
+    EXPECT_FALSE(record.restore(state));
+}
+
+TEST_F(RtcRecordTest, clear_removes_state) {
+    TestRecord record(slot, 1);
+    record.save({ 42, 12.5 });
+    record.clear();
+    EXPECT_FALSE(record.restore(state));
+}
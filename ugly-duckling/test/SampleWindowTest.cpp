@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include <SampleWindow.hpp>
+
+using farmhub::client::SampleWindow;
+
+class SampleWindowTest : public ::testing::Test {
+public:
+    SampleWindowTest() = default;
+
+    SampleWindow window;
+};
+
+TEST_F(SampleWindowTest, starts_empty) {
+    EXPECT_EQ(window.getCount(), 0u);
+    EXPECT_EQ(window.getMean(), 0);
+}
+
+TEST_F(SampleWindowTest, aggregates_samples) {
+    window.record(2);
+    window.record(-1);
+    window.record(5);
+    window.record(2);
+    EXPECT_EQ(window.getCount(), 4u);
+    EXPECT_EQ(window.getMin(), -1);
+    EXPECT_EQ(window.getMax(), 5);
+    EXPECT_EQ(window.getMean(), 2);
+    EXPECT_EQ(window.getLast(), 2);
+}
+
+TEST_F(SampleWindowTest, reset_starts_new_window) {
+    window.record(10);
+    window.record(20);
+    window.reset();
+    EXPECT_EQ(window.getCount(), 0u);
+
+    window.record(3);
+    EXPECT_EQ(window.getCount(), 1u);
+    EXPECT_EQ(window.getMin(), 3);
+    EXPECT_EQ(window.getMax(), 3);
+    EXPECT_EQ(window.getMean(), 3);
+    EXPECT_EQ(window.getLast(), 3);
+}
+
+TEST_F(SampleWindowTest, populates_json) {
+    window.record(1.5);
+    window.record(2.5);
+    DynamicJsonDocument doc(1024);
+    window.populate(doc.to<JsonObject>());
+    std::string json;
+    serializeJson(doc, json);
+    EXPECT_EQ(json, R"({"min":1.5,"max":2.5,"mean":2,"last":2.5,"count":2})");
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <TelemetryBatchPolicy.hpp>
+#include <WakePlanner.hpp>
+
+using farmhub::client::WakePlanner;
+
+class TelemetryBatchPolicyTest : public ::testing::Test {
+public:
+    TelemetryBatchRtcState state { 0, false, 0 };
+    TelemetryBatchPolicy::Wake wake { true, true, 4, 0, 4096, true };
+};
+
+TEST_F(TelemetryBatchPolicyTest, stays_offline_between_uploads) {
+    EXPECT_EQ(TelemetryBatchPolicy::reasonToGoOnline(state, wake), nullptr);
+    state.wakesSinceUpload = 2;
+    EXPECT_EQ(TelemetryBatchPolicy::reasonToGoOnline(state, wake), nullptr);
+}
+
+TEST_F(TelemetryBatchPolicyTest, goes_online_every_nth_wake) {
+    state.wakesSinceUpload = 3;
+    EXPECT_STREQ(TelemetryBatchPolicy::reasonToGoOnline(state, wake), "upload due");
+}
+
+TEST_F(TelemetryBatchPolicyTest, goes_online_when_needed) {
+    auto flowWake = wake;
+    flowWake.timerWake = false;
+    EXPECT_NE(TelemetryBatchPolicy::reasonToGoOnline(state, flowWake), nullptr);
+
+    auto fullWake = wake;
+    fullWake.batchUsed = 3500;
+    EXPECT_STREQ(TelemetryBatchPolicy::reasonToGoOnline(state, fullWake), "telemetry batch nearly full");
+
+    auto unsyncedWake = wake;
+    unsyncedWake.clockSynchronized = false;
+    EXPECT_STREQ(TelemetryBatchPolicy::reasonToGoOnline(state, unsyncedWake), "clock not set");
+
+    auto urgentState = state;
+    urgentState.urgentWake = true;
+    EXPECT_STREQ(TelemetryBatchPolicy::reasonToGoOnline(urgentState, wake), "urgent wake");
+}
+
+TEST_F(TelemetryBatchPolicyTest, sample_due_after_interval) {
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilSampleDue(0, minutes { 15 }, 1000000), microseconds::zero());
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilSampleDue(1000000, minutes { 15 }, 1000000), minutes { 15 });
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilSampleDue(1000000, minutes { 15 }, 1060000), minutes { 14 });
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilSampleDue(1000000, minutes { 15 }, 9000000), microseconds::zero());
+}
+
+TEST_F(TelemetryBatchPolicyTest, offline_wake_sleeps_until_next_sample) {
+    // The environment task never runs on offline wakes, only the sample kept in RTC memory tells when it is due
+    int64_t now = 1700000000000;
+    state.environmentSampledAt = now;
+    WakePlanner planner;
+    planner.require("environment telemetry", [&]() {
+        return TelemetryBatchPolicy::timeUntilEnvironmentDue(microseconds::zero(), state, minutes { 15 }, true, now);
+    });
+
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, minutes { 15 });
+    EXPECT_STREQ(plan.reason, "environment telemetry");
+}
+
+TEST_F(TelemetryBatchPolicyTest, environment_due_by_later_of_task_and_sample) {
+    int64_t now = 1700000000000;
+    state.environmentSampledAt = now - 60000;
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilEnvironmentDue(minutes { 20 }, state, minutes { 15 }, true, now), minutes { 20 });
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilEnvironmentDue(minutes { 5 }, state, minutes { 15 }, true, now), minutes { 14 });
+
+    // Never sampled offline, only the task counts
+    state.environmentSampledAt = 0;
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilEnvironmentDue(minutes { 5 }, state, minutes { 15 }, true, now), minutes { 5 });
+}
+
+TEST_F(TelemetryBatchPolicyTest, environment_due_by_task_without_clock) {
+    state.environmentSampledAt = 1700000000000;
+    EXPECT_EQ(TelemetryBatchPolicy::timeUntilEnvironmentDue(minutes { 5 }, state, minutes { 15 }, false, 0), minutes { 5 });
+}
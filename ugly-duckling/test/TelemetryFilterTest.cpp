@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <TelemetryFilter.hpp>
+
+using farmhub::client::TelemetryFilter;
+using std::chrono::milliseconds;
+using std::chrono::minutes;
+using std::chrono::seconds;
+
+class TelemetryFilterTest : public ::testing::Test {
+public:
+    TelemetryFilterTest() {
+        filter.setMaxSilence(minutes { 15 });
+        filter.setDeadband("soilMoisture", 1.0);
+        filter.setDeadband("temperature", 0.5);
+    }
+
+    std::string filtered(const char* telemetry, milliseconds now, bool expectedResult = true) {
+        DynamicJsonDocument doc(2048);
+        deserializeJson(doc, telemetry);
+        EXPECT_EQ(filter.filter(doc.as<JsonObject>(), now), expectedResult);
+        std::string result;
+        serializeJson(doc, result);
+        return result;
+    }
+
+    TelemetryFilter filter;
+};
+
+TEST_F(TelemetryFilterTest, reports_everything_first) {
+    EXPECT_EQ(filtered(R"({"soilMoisture":40,"valve":-1})", seconds { 0 }),
+        R"({"soilMoisture":40,"valve":-1})");
+}
+
+TEST_F(TelemetryFilterTest, drops_fields_within_deadband) {
+    filtered(R"({"soilMoisture":40,"valve":-1})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"soilMoisture":40.8,"valve":-1})", seconds { 60 }, false),
+        R"({})");
+}
+
+TEST_F(TelemetryFilterTest, reports_fields_outside_deadband) {
+    filtered(R"({"soilMoisture":40,"valve":-1})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"soilMoisture":41.5,"valve":-1})", seconds { 60 }),
+        R"({"soilMoisture":41.5})");
+    EXPECT_EQ(filtered(R"({"soilMoisture":38.9,"valve":1})", seconds { 120 }),
+        R"({"soilMoisture":38.9,"valve":1})");
+}
+
+TEST_F(TelemetryFilterTest, compares_to_last_reported_value) {
+    filtered(R"({"soilMoisture":40})", seconds { 0 });
+    // Slow drift is reported once it adds up
+    filtered(R"({"soilMoisture":40.6})", seconds { 60 }, false);
+    EXPECT_EQ(filtered(R"({"soilMoisture":41.2})", seconds { 120 }),
+        R"({"soilMoisture":41.2})");
+}
+
+TEST_F(TelemetryFilterTest, reports_any_change_without_deadband) {
+    filtered(R"({"volume":0,"mode":"auto"})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"volume":0,"mode":"auto"})", seconds { 60 }, false), R"({})");
+    EXPECT_EQ(filtered(R"({"volume":0.1,"mode":"manual"})", seconds { 120 }),
+        R"({"volume":0.1,"mode":"manual"})");
+}
+
+TEST_F(TelemetryFilterTest, reports_accumulated_fields_unless_zero) {
+    filter.setAccumulated("volume");
+    filtered(R"({"volume":0.5})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"volume":0.5})", seconds { 60 }), R"({"volume":0.5})");
+    EXPECT_EQ(filtered(R"({"volume":0})", seconds { 120 }, false), R"({})");
+}
+
+TEST_F(TelemetryFilterTest, compares_sampled_fields_by_mean) {
+    filtered(R"({"temperature":{"min":20,"max":22,"mean":21,"last":21,"count":4}})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"temperature":{"min":19,"max":23,"mean":21.2,"last":22,"count":4}})", seconds { 60 }, false),
+        R"({})");
+    EXPECT_EQ(filtered(R"({"temperature":{"min":21,"max":23,"mean":21.6,"last":23,"count":4}})", seconds { 120 }),
+        R"({"temperature":{"min":21,"max":23,"mean":21.6,"last":23,"count":4}})");
+}
+
+TEST_F(TelemetryFilterTest, reports_everything_after_max_silence) {
+    filtered(R"({"soilMoisture":40,"valve":-1})", seconds { 0 });
+    filtered(R"({"soilMoisture":40,"valve":-1})", minutes { 14 }, false);
+    EXPECT_EQ(filtered(R"({"soilMoisture":40,"valve":-1})", minutes { 15 }),
+        R"({"soilMoisture":40,"valve":-1})");
+    filtered(R"({"soilMoisture":40,"valve":-1})", minutes { 16 }, false);
+}
+
+TEST_F(TelemetryFilterTest, zero_max_silence_disables_filtering) {
+    filter.setMaxSilence(milliseconds::zero());
+    filtered(R"({"soilMoisture":40})", seconds { 0 });
+    EXPECT_EQ(filtered(R"({"soilMoisture":40})", seconds { 60 }), R"({"soilMoisture":40})");
+}
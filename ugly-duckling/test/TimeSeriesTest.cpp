@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include <TimeSeries.hpp>
+
+using namespace farmhub::client;
+
+class MemoryRingStorage : public RingStorage {
+public:
+    bool read(size_t offset, void* buffer, size_t length) override {
+        if (offset + length > data.size()) {
+            return false;
+        }
+        memcpy(buffer, data.data() + offset, length);
+        return true;
+    }
+
+    bool write(size_t offset, const void* buffer, size_t length) override {
+        if (offset + length > data.size()) {
+            data.resize(offset + length);
+        }
+        memcpy(data.data() + offset, buffer, length);
+        return true;
+    }
+
+    std::vector<uint8_t> data;
+};
+
+class TimeSeriesTest : public ::testing::Test {
+public:
+    TimeSeriesTest() = default;
+
+    std::vector<uint32_t> timesOf(RecordRing<RawSample>& ring, uint32_t from = 0, uint32_t to = UINT32_MAX) {
+        std::vector<uint32_t> times;
+        ring.query(from, to, [&](const RawSample& sample) {
+            times.push_back(sample.time);
+            return true;
+        });
+        return times;
+    }
+
+    MemoryRingStorage storage;
+};
+
+TEST_F(TimeSeriesTest, downsampler_closes_periods) {
+    Downsampler downsampler(60);
+    RollupSample completed;
+    EXPECT_FALSE(downsampler.add(120, 1, completed));
+    EXPECT_FALSE(downsampler.add(150, 3, completed));
+    EXPECT_FALSE(downsampler.add(179, 2, completed));
+    EXPECT_TRUE(downsampler.add(180, 10, completed));
+    EXPECT_EQ(completed.time, 120u);
+    EXPECT_EQ(completed.min, 1);
+    EXPECT_EQ(completed.max, 3);
+    EXPECT_EQ(completed.mean, 2);
+    EXPECT_EQ(completed.count, 3u);
+
+    EXPECT_TRUE(downsampler.add(400, 0, completed));
+    EXPECT_EQ(completed.time, 180u);
+    EXPECT_EQ(completed.min, 10);
+    EXPECT_EQ(completed.max, 10);
+    EXPECT_EQ(completed.count, 1u);
+}
+
+TEST_F(TimeSeriesTest, ring_keeps_records_in_order) {
+    RecordRing<RawSample> ring(storage, 4);
+    ring.begin();
+    EXPECT_EQ(ring.size(), 0u);
+    EXPECT_EQ(ring.oldestTime(), 0u);
+    ring.append({ 10, 1 });
+    ring.append({ 20, 2 });
+    EXPECT_EQ(ring.size(), 2u);
+    EXPECT_EQ(timesOf(ring), (std::vector<uint32_t> { 10, 20 }));
+}
+
+TEST_F(TimeSeriesTest, ring_overwrites_oldest_records) {
+    RecordRing<RawSample> ring(storage, 3);
+    ring.begin();
+    for (uint32_t time = 1; time <= 5; time++) {
+        ring.append({ time, 0 });
+    }
+    EXPECT_EQ(ring.size(), 3u);
+    EXPECT_EQ(ring.oldestTime(), 3u);
+    EXPECT_EQ(timesOf(ring), (std::vector<uint32_t> { 3, 4, 5 }));
+}
+
+TEST_F(TimeSeriesTest, ring_queries_time_range) {
+    RecordRing<RawSample> ring(storage, 10);
+    ring.begin();
+    for (uint32_t time = 10; time <= 60; time += 10) {
+        ring.append({ time, 0 });
+    }
+    EXPECT_EQ(timesOf(ring, 20, 50), (std::vector<uint32_t> { 20, 30, 40 }));
+
+    std::vector<uint32_t> limited;
+    ring.query(0, UINT32_MAX, [&](const RawSample& sample) {
+        limited.push_back(sample.time);
+        return limited.size() < 2;
+    });
+    EXPECT_EQ(limited, (std::vector<uint32_t> { 10, 20 }));
+}
+
+TEST_F(TimeSeriesTest, ring_survives_restart) {
+    {
+        RecordRing<RawSample> ring(storage, 3);
+        ring.begin();
+        for (uint32_t time = 1; time <= 4; time++) {
+            ring.append({ time, 0 });
+        }
+    }
+    RecordRing<RawSample> ring(storage, 3);
+    ring.begin();
+    EXPECT_EQ(timesOf(ring), (std::vector<uint32_t> { 2, 3, 4 }));
+}
+
+TEST_F(TimeSeriesTest, ring_starts_over_when_layout_changes) {
+    {
+        RecordRing<RawSample> ring(storage, 3);
+        ring.begin();
+        ring.append({ 1, 0 });
+    }
+    RecordRing<RawSample> ring(storage, 5);
+    ring.begin();
+    EXPECT_EQ(ring.size(), 0u);
+}
+
+TEST_F(TimeSeriesTest, ring_queries_tail_newest_first) {
+    RecordRing<RawSample> ring(storage, 4);
+    ring.begin();
+    EXPECT_EQ(ring.newestTime(), 0u);
+    for (uint32_t time : { 10, 20, 30, 40, 50 }) {
+        ring.append({ time, 0 });
+    }
+    EXPECT_EQ(ring.newestTime(), 50u);
+
+    std::vector<uint32_t> times;
+    ring.queryTail(30, [&](const RawSample& sample) {
+        times.push_back(sample.time);
+    });
+    EXPECT_EQ(times, (std::vector<uint32_t> { 50, 40, 30 }));
+}
+
+TEST_F(TimeSeriesTest, downsampler_resumes_open_period_after_restart) {
+    {
+        RecordRing<RawSample> raw(storage, 10);
+        raw.begin();
+        Downsampler downsampler(60);
+        RollupSample completed;
+        for (auto sample : std::vector<RawSample> { { 100, 5 }, { 120, 1 }, { 150, 3 } }) {
+            raw.append(sample);
+            downsampler.add(sample.time, sample.value, completed);
+        }
+    }
+
+    RecordRing<RawSample> raw(storage, 10);
+    raw.begin();
+    Downsampler downsampler(60);
+    downsampler.resume(raw);
+    RollupSample completed;
+    EXPECT_TRUE(downsampler.add(180, 10, completed));
+    EXPECT_EQ(completed.time, 120u);
+    EXPECT_EQ(completed.min, 1);
+    EXPECT_EQ(completed.max, 3);
+    EXPECT_EQ(completed.mean, 2);
+    EXPECT_EQ(completed.count, 2u);
+}
+
+TEST_F(TimeSeriesTest, downsampler_resumes_nothing_from_empty_ring) {
+    RecordRing<RawSample> raw(storage, 10);
+    raw.begin();
+    Downsampler downsampler(60);
+    downsampler.resume(raw);
+    RollupSample completed;
+    EXPECT_FALSE(downsampler.add(180, 10, completed));
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "UlpPulseCounter.hpp"
+
+class UlpPulseCounterTest : public ::testing::Test {
+public:
+    /**
+     * @brief Feeds the given number of pulses, each lasting two ticks high and two ticks low.
+     *
+     * @return the number of ticks until the counter asked to wake the CPU, or -1 if it never did.
+     */
+    int pulse(int pulses) {
+        for (int i = 0; i < pulses; i++) {
+            for (bool level : { true, true, false, false }) {
+                ticks++;
+                if (counter.tick(level)) {
+                    return ticks;
+                }
+            }
+        }
+        return -1;
+    }
+
+    void idle(int count) {
+        for (int i = 0; i < count; i++) {
+            ticks++;
+            EXPECT_FALSE(counter.tick(false));
+        }
+    }
+
+    UlpPulseCounterModel counter;
+    int ticks = 0;
+};
+
+TEST_F(UlpPulseCounterTest, counts_rising_edges_only) {
+    counter.start(100, 0xFFFF, 60000, false);
+    EXPECT_EQ(pulse(10), -1);
+    EXPECT_EQ(counter.getPulses(), 10);
+}
+
+TEST_F(UlpPulseCounterTest, pin_high_at_start_is_not_a_pulse) {
+    counter.start(100, 0xFFFF, 60000, true);
+    EXPECT_FALSE(counter.tick(true));
+    EXPECT_EQ(counter.getPulses(), 0);
+}
+
+TEST_F(UlpPulseCounterTest, wakes_at_volume_threshold) {
+    counter.start(5, 0xFFFF, 60000, false);
+    EXPECT_EQ(pulse(4), -1);
+    idle(1000);
+    EXPECT_NE(pulse(1), -1);
+    EXPECT_EQ(counter.getPulses(), 5);
+}
+
+TEST_F(UlpPulseCounterTest, wakes_when_rate_is_exceeded) {
+    // At most 10 pulses in 100 ticks
+    counter.start(1000, 10, 100, false);
+    EXPECT_NE(pulse(20), -1);
+    EXPECT_EQ(counter.getPulses(), 10);
+}
+
+TEST_F(UlpPulseCounterTest, slow_flow_does_not_exceed_rate) {
+    // At most 10 pulses in 100 ticks
+    counter.start(1000, 10, 100, false);
+    for (int i = 0; i < 50; i++) {
+        EXPECT_EQ(pulse(5), -1);
+        idle(80);
+    }
+    EXPECT_EQ(counter.getPulses(), 250);
+}
+
+TEST_F(UlpPulseCounterTest, keeps_asking_to_wake_until_stopped) {
+    counter.start(1, 0xFFFF, 60000, false);
+    EXPECT_EQ(pulse(1), 1);
+    // The CPU might not be ready to wake up yet, so the ULP keeps trying
+    EXPECT_TRUE(counter.tick(true));
+    EXPECT_TRUE(counter.tick(false));
+}
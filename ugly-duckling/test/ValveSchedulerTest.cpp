@@ -95,3 +95,36 @@ TEST_F(ValveSchedulerTest, matches_multiple_schedules) {
     EXPECT_TRUE(scheduler.isScheduled(schedules, base + minutes { 2 } + seconds { 74 }));
     EXPECT_FALSE(scheduler.isScheduled(schedules, base + minutes { 2 } + seconds { 75 }));
 }
+
+TEST_F(ValveSchedulerTest, no_transition_when_empty) {
+    EXPECT_EQ(scheduler.nextTransition({}, base), time_point<system_clock>::max());
+}
+
+TEST_F(ValveSchedulerTest, next_transition_of_single_schedule) {
+    std::list<ValveSchedule> schedules {
+        ValveSchedule(base, minutes { 1 }, seconds { 15 }),
+    };
+    EXPECT_EQ(scheduler.nextTransition(schedules, base - seconds { 10 }), base);
+    EXPECT_EQ(scheduler.nextTransition(schedules, base), base + seconds { 15 });
+    EXPECT_EQ(scheduler.nextTransition(schedules, base + seconds { 14 }), base + seconds { 15 });
+    EXPECT_EQ(scheduler.nextTransition(schedules, base + seconds { 15 }), base + seconds { 60 });
+    EXPECT_EQ(scheduler.nextTransition(schedules, base + seconds { 59 }), base + seconds { 60 });
+}
+
+TEST_F(ValveSchedulerTest, next_transition_skips_overlapping_boundaries) {
+    std::list<ValveSchedule> schedules {
+        ValveSchedule(base, minutes { 1 }, seconds { 15 }),
+        ValveSchedule(base, minutes { 5 }, seconds { 60 }),
+    };
+    // The first schedule ends at 15 seconds, but the second one keeps the valve open until 75 seconds
+    EXPECT_EQ(scheduler.nextTransition(schedules, base), base + seconds { 75 });
+    EXPECT_EQ(scheduler.nextTransition(schedules, base + seconds { 75 }), base + minutes { 2 });
+}
+
+TEST_F(ValveSchedulerTest, no_transition_when_always_open) {
+    std::list<ValveSchedule> schedules {
+        ValveSchedule(base, minutes { 1 }, minutes { 1 }),
+    };
+    EXPECT_EQ(scheduler.nextTransition(schedules, base - seconds { 10 }), base);
+    EXPECT_EQ(scheduler.nextTransition(schedules, base), time_point<system_clock>::max());
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include <WakePlanner.hpp>
+
+using farmhub::client::WakePlanner;
+
+class WakePlannerTest : public ::testing::Test {
+public:
+    WakePlanner planner;
+};
+
+TEST_F(WakePlannerTest, sleeps_for_maximum_without_requirements) {
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, hours { 1 });
+    EXPECT_EQ(plan.reason, nullptr);
+}
+
+TEST_F(WakePlannerTest, sleeps_until_earliest_requirement) {
+    planner.require("valve", []() -> microseconds { return minutes { 20 }; });
+    planner.require("telemetry", []() -> microseconds { return minutes { 5 }; });
+    planner.require("never", []() { return microseconds::max(); });
+
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, minutes { 5 });
+    EXPECT_STREQ(plan.reason, "telemetry");
+}
+
+TEST_F(WakePlannerTest, never_sleeps_longer_than_maximum) {
+    planner.require("valve", []() -> microseconds { return hours { 5 }; });
+
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, hours { 1 });
+    EXPECT_EQ(plan.reason, nullptr);
+}
+
+TEST_F(WakePlannerTest, stays_awake_when_requirement_is_due_soon) {
+    planner.require("valve", []() -> microseconds { return seconds { 10 }; });
+
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, microseconds::zero());
+    EXPECT_STREQ(plan.reason, "valve");
+}
+
+TEST_F(WakePlannerTest, stays_awake_when_requirement_is_overdue) {
+    planner.require("telemetry", []() -> microseconds { return seconds { -10 }; });
+
+    auto plan = planner.plan(hours { 1 }, seconds { 30 });
+    EXPECT_EQ(plan.duration, microseconds::zero());
+}